@@ -11,7 +11,7 @@ make distclean
 
 if [ $1 == "glnx64" ]; then
 
-    g++ src/*.cpp -o $PKG/gconv -s -O2 -std=c++11 -static
+    g++ src/*.cpp -o $PKG/gconv -s -O2 -std=c++11 -pthread -static
     qmake-qt5 src/gui
     make
     strip gconv-gui
@@ -19,7 +19,7 @@ if [ $1 == "glnx64" ]; then
 
 elif [ $1 == "win32" ]; then
 
-    i686-w64-mingw32-g++ src/*.cpp -o $PKG/gconv.exe -s -O2 -std=c++11 -static
+    i686-w64-mingw32-g++ src/*.cpp -o $PKG/gconv.exe -s -O2 -std=c++11 -pthread -static -lpsapi
     i686-w64-mingw32-qmake-qt4 "CONFIG += static" src/gui
     make release
     i686-w64-mingw32-strip release/gconv-gui.exe
@@ -27,7 +27,7 @@ elif [ $1 == "win32" ]; then
 
 elif [ $1 == "win64" ]; then
 
-    x86_64-w64-mingw32-g++ src/*.cpp -o $PKG/gconv.exe -s -O2 -std=c++11 -static
+    x86_64-w64-mingw32-g++ src/*.cpp -o $PKG/gconv.exe -s -O2 -std=c++11 -pthread -static -lpsapi
     x86_64-w64-mingw32-qmake-qt4 "CONFIG += static" src/gui
     make release
     x86_64-w64-mingw32-strip release/gconv-gui.exe
@@ -39,7 +39,7 @@ elif [ $1 == "macos" ]; then
     export LDFLAGS="-L/usr/local/opt/qt/lib"
     export CPPFLAGS="-I/usr/local/opt/qt/include"
 
-    g++ src/*.cpp -o $PKG/gconv -O2 -std=c++11
+    g++ src/*.cpp -o $PKG/gconv -O2 -std=c++11 -pthread
     qmake src/gui
     make
     macdeployqt gconv-gui.app
@@ -0,0 +1,335 @@
+// Benchmark of gconv readers, writers and conversion paths on synthetic data
+//
+//   g++ src/bench/bench.cpp $(ls src/*.cpp | grep -v main.cpp) -o gconv-bench -O2 -std=c++11 -pthread
+//
+//   gconv-bench --loci 100000 --samples 500 --ploidy 2 --alleles 2
+//
+// Results are written to stdout as tab-delimited lines, one per case.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <functional>
+#include "../cmdline.h"
+#include "../vcf.h"
+#include "../ped.h"
+#include "../hmp.h"
+#include "../geno.h"
+#include "../perf.h"
+#include "../util.h"
+
+
+using std::size_t;
+
+
+namespace {
+
+
+struct Parameter
+{
+    std::string dir;
+    std::string formats;
+    size_t loci = 10000;
+    size_t samples = 100;
+    int ploidy = 2;
+    int alleles = 2;
+    int repeat = 1;
+    unsigned seed = 1;
+    bool keep = false;
+} par;
+
+
+struct Result
+{
+    std::string name;
+    std::uint64_t bytes = 0;
+    std::uint64_t records = 0;
+    double wall = 0.0;
+    double cpu = 0.0;
+    std::uint64_t rss = 0;
+};
+
+
+// xorshift64*, the data set only depends on the seed
+class Random
+{
+public:
+    explicit Random(unsigned seed) : s_(0x9E3779B97F4A7C15ULL ^ seed) { next(); }
+
+    std::uint64_t next()
+    {
+        s_ ^= s_ >> 12;
+        s_ ^= s_ << 25;
+        s_ ^= s_ >> 27;
+        return s_ * 0x2545F4914F6CDD1DULL;
+    }
+
+    // uniform in [0, n)
+    std::uint64_t next(std::uint64_t n) { return next() % n; }
+
+private:
+    std::uint64_t s_;
+};
+
+
+// na <= 4: single-base SNP alleles; otherwise distinct SSR-like allele strings
+void generate(Genotype &gt)
+{
+    Random rng(par.seed);
+
+    static const char bases[] = "ACGT";
+
+    auto m = par.loci;
+    auto n = par.samples;
+    size_t nchr = std::max(size_t(1), std::min(size_t(10), m / 100));
+
+    gt = Genotype();
+    gt.ploidy = par.ploidy;
+
+    for (size_t i = 0; i < n; ++i)
+        gt.ind.push_back("S" + std::to_string(i+1));
+
+    pos_t pos = 0;
+    for (size_t j = 0; j < m; ++j) {
+        auto c = j * nchr / m + 1;
+        if (j == 0 || c != (j - 1) * nchr / m + 1)
+            pos = 0;
+        pos += 1 + static_cast<pos_t>(rng.next(1000));
+
+        gt.loc.push_back("m" + std::to_string(j+1));
+        gt.chr.push_back(std::to_string(c));
+        gt.pos.push_back(pos);
+
+        std::vector<std::string> as;
+        if (par.alleles <= 4) {
+            auto k = rng.next(4);
+            for (int a = 0; a < par.alleles; ++a)
+                as.emplace_back(1, bases[(k + a) % 4]);
+        }
+        else {
+            auto k = 100 + rng.next(100);
+            for (int a = 0; a < par.alleles; ++a)
+                as.push_back(std::to_string(k + 2 * a));
+        }
+        gt.allele.push_back(as);
+
+        // skewed allele frequency, about 5% missing
+        std::vector<allele_t> v;
+        auto w = allele_width(as.size());
+        v.reserve(n * par.ploidy * w);
+        auto alt = 1 + rng.next(50);
+        for (size_t i = 0; i < n * par.ploidy; ++i) {
+            auto r = rng.next(100);
+            if (r < 5)
+                push_allele(v, 0, w);
+            else if (r < 5 + alt && par.alleles > 1)
+                push_allele(v, static_cast<unsigned>(2 + rng.next(par.alleles - 1)), w);
+            else
+                push_allele(v, 1, w);
+        }
+        gt.dat.push_back(v);
+    }
+}
+
+std::string data_file(const std::string &fmt)
+{
+    auto path = par.dir.empty() ? std::string("gconv-bench") : par.dir + "/gconv-bench";
+    return path + "." + fmt;
+}
+
+std::uint64_t data_size(const std::string &fmt)
+{
+    if (fmt == "ped") {
+        auto prefix = data_file("");
+        prefix.pop_back();
+        return file_size(prefix + ".ped") + file_size(prefix + ".map");
+    }
+    return file_size(data_file(fmt));
+}
+
+int read_data(const std::string &fmt, const std::string &filename, Genotype &gt)
+{
+    if (fmt == "vcf")
+        return read_vcf(filename, gt);
+    if (fmt == "hmp")
+        return read_hmp(filename, gt);
+    if (fmt == "geno")
+        return read_geno(filename, gt);
+    return read_ped(filename.substr(0, filename.size() - 4), gt);
+}
+
+int write_data(const std::string &fmt, const Genotype &gt, const std::string &filename)
+{
+    if (fmt == "vcf")
+        return write_vcf(gt, filename);
+    if (fmt == "hmp")
+        return write_hmp(gt, filename);
+    if (fmt == "geno")
+        return write_geno(gt, filename);
+    return write_ped(gt, filename.substr(0, filename.size() - 4));
+}
+
+// best of repeated runs; peak RSS is reset before each run where the OS allows it
+bool measure(Result &res, const std::function<int()> &job)
+{
+    for (int r = 0; r < par.repeat; ++r) {
+        reset_peak_rss();
+
+        auto w = wall_time();
+        auto c = cpu_time();
+
+        if (job() != 0)
+            return false;
+
+        w = wall_time() - w;
+        c = cpu_time() - c;
+
+        if (r == 0 || w < res.wall) {
+            res.wall = w;
+            res.cpu = c;
+        }
+
+        res.rss = std::max(res.rss, peak_rss());
+    }
+
+    return true;
+}
+
+void print_header()
+{
+    std::cout << "case\tloci\tsamples\tploidy\talleles\tbytes\trecords\twall_s\tcpu_s\tMB/s\trecords/s\tpeak_rss_MB\n";
+}
+
+void print(const Result &res)
+{
+    auto mbs = res.wall > 0 ? res.bytes / 1e6 / res.wall : 0.0;
+    auto rps = res.wall > 0 ? res.records / res.wall : 0.0;
+
+    std::cout << res.name << "\t" << par.loci << "\t" << par.samples << "\t" << par.ploidy << "\t" << par.alleles
+              << "\t" << res.bytes << "\t" << res.records << std::fixed << std::setprecision(3)
+              << "\t" << res.wall << "\t" << res.cpu << "\t" << mbs << "\t" << std::setprecision(0) << rps
+              << "\t" << std::setprecision(1) << res.rss / 1048576.0 << "\n" << std::defaultfloat;
+}
+
+void skip(const std::string &name)
+{
+    std::cerr << "INFO: skipped " << name << ", not supported by the data set\n";
+}
+
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    CmdLine cmd;
+
+    cmd.add("--loci", "number of loci", "10000");
+    cmd.add("--samples", "number of samples", "100");
+    cmd.add("--ploidy", "ploidy, HapMap and PED are skipped above 2", "2");
+    cmd.add("--alleles", "number of alleles per locus", "2");
+    cmd.add("--seed", "random seed of the data generator", "1");
+    cmd.add("--repeat", "number of runs per case, the fastest is reported", "1");
+    cmd.add("--formats", "comma-separated formats to benchmark", "vcf,hmp,ped,geno");
+    cmd.add("--dir", "directory for the generated files", "");
+    cmd.add("--keep", "keep the generated files");
+
+    cmd.parse(argc, argv);
+
+    par.loci = std::stoul(cmd.get("--loci"));
+    par.samples = std::stoul(cmd.get("--samples"));
+    par.ploidy = std::stoi(cmd.get("--ploidy"));
+    par.alleles = std::stoi(cmd.get("--alleles"));
+    par.seed = static_cast<unsigned>(std::stoul(cmd.get("--seed")));
+    par.repeat = std::max(1, std::stoi(cmd.get("--repeat")));
+    par.formats = cmd.get("--formats");
+    par.dir = cmd.get("--dir");
+    par.keep = cmd.has("--keep");
+
+    if (par.ploidy < 1) {
+        std::cerr << "ERROR: unsupported ploidy: " << par.ploidy << "\n";
+        return 1;
+    }
+
+    if (par.alleles < 1 || par.alleles > max_alleles) {
+        std::cerr << "ERROR: number of alleles must be within [1, " << max_alleles << "]: " << par.alleles << "\n";
+        return 1;
+    }
+
+    auto fmts = split(par.formats, ",");
+
+    Genotype gt;
+    generate(gt);
+
+    print_header();
+
+    // writers, which also create the input files of the readers
+    std::vector<std::string> avail;
+    for (auto &f : fmts) {
+        Result res;
+        res.name = "write_" + f;
+        res.records = gt.loc.size();
+        if ( ! measure(res, [&]() { return write_data(f, gt, data_file(f)); }) ) {
+            skip(res.name);
+            continue;
+        }
+        res.bytes = data_size(f);
+        print(res);
+        avail.push_back(f);
+    }
+
+    gt = Genotype();
+
+    for (auto &f : avail) {
+        Result res;
+        res.name = "read_" + f;
+        res.bytes = data_size(f);
+        if ( ! measure(res, [&]() { Genotype g; auto info = read_data(f, data_file(f), g); res.records = g.loc.size(); return info; }) ) {
+            skip(res.name);
+            continue;
+        }
+        print(res);
+    }
+
+    // full conversion paths, output goes to a separate file
+    for (auto &f : avail) {
+        for (auto &t : fmts) {
+            Result res;
+            res.name = f + "_to_" + t;
+            res.bytes = data_size(f);
+            auto out = data_file("out." + t);
+            if ( ! measure(res, [&]() {
+                Genotype g;
+                if (read_data(f, data_file(f), g) != 0)
+                    return 1;
+                res.records = g.loc.size();
+                return write_data(t, g, out);
+            }) ) {
+                skip(res.name);
+                continue;
+            }
+            print(res);
+            if (t == "ped") {
+                std::remove(data_file("out.ped").c_str());
+                std::remove(data_file("out.map").c_str());
+            }
+            else
+                std::remove(out.c_str());
+        }
+    }
+
+    if ( ! par.keep ) {
+        for (auto &f : avail) {
+            if (f == "ped") {
+                std::remove(data_file("ped").c_str());
+                std::remove(data_file("map").c_str());
+            }
+            else
+                std::remove(data_file(f).c_str());
+        }
+    }
+
+    return 0;
+}
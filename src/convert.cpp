@@ -0,0 +1,452 @@
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include "convert.h"
+#include "vcf.h"
+#include "ped.h"
+#include "hmp.h"
+#include "geno.h"
+#include "mapfile.h"
+#include "perf.h"
+#include "log.h"
+#include "progress.h"
+#include "util.h"
+
+
+using std::size_t;
+
+
+namespace {
+
+std::string ped_prefix(const std::string &filename)
+{
+    return ends_with(filename, ".ped") ? filename.substr(0, filename.size() - 4) : filename;
+}
+
+// loci is null for all loci, see locus_index
+int write_genotype(const Genotype &gt, const std::string &filename, Format format, Progress *progress,
+                   const std::vector<size_t> *loci = nullptr)
+{
+    if (format == Format::unknown)
+        format = format_of(filename);
+
+    if ( ! gt.raw.empty() && format != Format::vcf ) {
+        log_stream() << "ERROR: VCF passthrough data can only be written to VCF: " << filename << "\n";
+        return 1;
+    }
+
+    if (filename == "-" && format == Format::ped) {
+        log_stream() << "ERROR: PED and MAP files can't be written to stdout\n";
+        return 1;
+    }
+
+    switch (format) {
+    case Format::vcf:
+        return write_vcf(gt, filename, true, progress, loci);
+    case Format::ped:
+        return write_ped(gt, ped_prefix(filename), progress, loci);
+    case Format::hmp:
+        return write_hmp(gt, filename, progress, loci);
+    case Format::geno:
+        return write_geno(gt, filename, progress, loci);
+    default:
+        log_stream() << "ERROR: unrecognized output format: " << filename << "\n";
+        return 1;
+    }
+}
+
+} // namespace
+
+
+Format format_of(const std::string &filename)
+{
+    if ( ends_with(filename, ".vcf") )
+        return Format::vcf;
+
+    if ( ends_with(filename, ".ped") )
+        return Format::ped;
+
+    if ( ends_with(filename, ".hmp") )
+        return Format::hmp;
+
+    if ( ends_with(filename, ".geno") )
+        return Format::geno;
+
+    return Format::unknown;
+}
+
+Format parse_format(const std::string &name)
+{
+    if (name == "vcf")
+        return Format::vcf;
+
+    if (name == "ped")
+        return Format::ped;
+
+    if (name == "hmp")
+        return Format::hmp;
+
+    if (name == "geno")
+        return Format::geno;
+
+    return Format::unknown;
+}
+
+std::uint64_t genotype_file_size(const std::string &filename)
+{
+    if (filename == "-")
+        return 0;
+
+    if ( ends_with(filename, ".ped") ) {
+        auto prefix = ped_prefix(filename);
+        return file_size(prefix + ".ped") + file_size(prefix + ".map");
+    }
+
+    return file_size(filename);
+}
+
+std::string chr_file_name(const std::string &filename, const std::string &chr)
+{
+    auto pos = filename.find_last_of('.');
+    if (pos == std::string::npos || filename.find_first_of("/\\", pos) != std::string::npos)
+        return filename + "." + chr;
+
+    return filename.substr(0, pos) + "." + chr + filename.substr(pos);
+}
+
+int chr_grouped(Format format, const std::string &filename)
+{
+    if ((format != Format::vcf && format != Format::hmp) || filename == "-")
+        return -1;
+
+    MappedFile in(filename);
+    if ( ! in )
+        return -1;
+
+    auto data = in.data();
+    auto size = in.size();
+
+    // the chromosome is the first VCF column and the third HapMap column
+    size_t field = format == Format::vcf ? 0 : 2;
+    bool hmp = format == Format::hmp;
+    auto delim = [hmp](char c) { return c == '\t' || (hmp && c == ' '); };
+
+    std::unordered_set<std::string> seen;
+    std::string chr;
+    bool header = hmp;
+
+    for (size_t i = 0; i < size; ) {
+        auto p = data + i;
+        auto end = static_cast<const char*>(std::memchr(p, '\n', size - i));
+        size_t n = end ? end - p : size - i;
+        i += end ? n + 1 : n;
+
+        if ( header || n == 0 || p[0] == '#' ) {
+            header = false;
+            continue;
+        }
+
+        size_t b = 0;
+        for (size_t f = 0; f < field && b < n; ++f) {
+            while (b < n && ! delim(p[b]))
+                ++b;
+            while (b < n && delim(p[b]))
+                ++b;
+        }
+
+        auto e = b;
+        while (e < n && ! delim(p[e]) && p[e] != '\r')
+            ++e;
+
+        if (chr.size() == e - b && chr.compare(0, chr.size(), p + b, e - b) == 0)
+            continue;
+
+        chr.assign(p + b, e - b);
+        if ( ! seen.insert(chr).second )
+            return 0;
+    }
+
+    return 1;
+}
+
+int load_genotype(Format format, const std::vector<std::string> &filenames, Genotype &gt, Progress *progress,
+                  bool passthrough, GenotypeSummary *summary)
+{
+    if ( filenames.empty() ) {
+        log_stream() << "ERROR: no input genotype file\n";
+        return 1;
+    }
+
+    if (format != Format::vcf && filenames.size() > 1) {
+        log_stream() << "ERROR: only VCF files can be concatenated\n";
+        return 1;
+    }
+
+    if (format != Format::vcf && passthrough) {
+        log_stream() << "ERROR: passthrough is only supported for VCF input\n";
+        return 1;
+    }
+
+    // PED comes with a MAP file, the general format is read twice if alleles aren't characters
+    if ((format == Format::ped || format == Format::geno) && filenames[0] == "-") {
+        log_stream() << "ERROR: only VCF and HapMap can be read from stdin\n";
+        return 1;
+    }
+
+    if ( progress ) {
+        std::uint64_t bytes = 0;
+        for (auto &e : filenames)
+            bytes += genotype_file_size(format == Format::ped ? ped_prefix(e) + ".ped" : e);
+        progress->begin("read", bytes);
+    }
+
+    int info = 1;
+
+    switch (format) {
+    case Format::vcf:
+        info = read_vcf(filenames, gt, progress, passthrough, summary);
+        break;
+    case Format::ped:
+        info = read_ped(ped_prefix(filenames[0]), gt, progress, summary);
+        break;
+    case Format::hmp:
+        info = read_hmp(filenames[0], gt, progress, summary);
+        break;
+    case Format::geno:
+        info = read_geno(filenames[0], gt, progress, summary);
+        break;
+    default:
+        log_stream() << "ERROR: unrecognized input format: " << filenames[0] << "\n";
+        break;
+    }
+
+    if ( progress ) {
+        progress->end();
+        if ( progress->cancelled() )
+            info = 1;
+    }
+
+    return info;
+}
+
+void sort_chrpos(Genotype &gt, Progress *progress)
+{
+    if ( progress )
+        progress->begin("sort", 0, gt.loc.size());
+
+    auto chr = unique(gt.chr);
+
+    auto m = gt.loc.size();
+    std::vector<size_t> z;
+    z.reserve(m);
+
+    for (auto &e : chr) {
+        std::vector<size_t> idx;
+        for (size_t i = 0; i < m; ++i) {
+            if (gt.chr[i] == e)
+                idx.push_back(i);
+        }
+
+        // loci of equal positions keep their input order, as in sort_vcf_index
+        auto less = [&gt](size_t a, size_t b) { return gt.pos[a] < gt.pos[b]; };
+        if ( ! std::is_sorted(idx.begin(), idx.end(), less) )
+            std::stable_sort(idx.begin(), idx.end(), less);
+
+        z.insert(z.end(), idx.begin(), idx.end());
+    }
+
+    subset(gt.loc,z).swap(gt.loc);
+    subset(gt.chr,z).swap(gt.chr);
+    subset(gt.pos,z).swap(gt.pos);
+    subset(gt.dat,z).swap(gt.dat);
+    gt.allele = gt.allele.subset(z);
+
+    if ( ! gt.flag.empty() )
+        subset(gt.flag,z).swap(gt.flag);
+
+    if ( ! gt.raw.empty() )
+        subset(gt.raw,z).swap(gt.raw);
+
+    if ( progress ) {
+        progress->add(0, m);
+        progress->end();
+    }
+}
+
+int save_genotype(const Genotype &gt, const std::string &filename, Progress *progress, Format format)
+{
+    if (format == Format::unknown)
+        format = format_of(filename);
+
+    // PED writer reports one record per sample line, the others one per locus
+    if ( progress )
+        progress->begin("write", 0, format == Format::ped ? gt.ind.size() : gt.loc.size());
+
+    int info = write_genotype(gt, filename, format, progress);
+
+    if ( progress ) {
+        progress->end();
+        if ( progress->cancelled() )
+            info = 1;
+    }
+
+    return info;
+}
+
+int save_genotype_by_chr(const Genotype &gt, const std::string &filename, Progress *progress, Format format)
+{
+    if (format == Format::unknown)
+        format = format_of(filename);
+
+    if (format == Format::unknown) {
+        log_stream() << "ERROR: unrecognized output format: " << filename << "\n";
+        return 1;
+    }
+
+    if (filename == "-") {
+        log_stream() << "ERROR: chromosome files can't be written to stdout\n";
+        return 1;
+    }
+
+    auto chr = stable_unique(gt.chr);
+    auto nc = chr.size();
+
+    // input is usually grouped by chromosome, look up the previous group first
+    std::vector< std::vector<size_t> > idx(nc);
+    auto m = gt.loc.size();
+    size_t k = 0;
+    for (size_t j = 0; j < m; ++j) {
+        if (gt.chr[j] != chr[k])
+            k = index(chr, gt.chr[j]);
+        idx[k].push_back(j);
+    }
+
+    if ( progress )
+        progress->begin("write", 0, format == Format::ped ? gt.ind.size() * nc : m);
+
+    std::vector<int> info(nc, 0);
+
+    // each file is written from the loci of its chromosome in place, nothing is copied
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t c = next++; c < nc; c = next++)
+            info[c] = write_genotype(gt, chr_file_name(filename, chr[c]), format, progress, &idx[c]);
+    };
+
+    size_t nt = std::thread::hardware_concurrency();
+    nt = std::max(size_t(1), std::min(nt, nc));
+
+    // pool threads log where the calling thread does
+    auto log = log_handler();
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < nt; ++t) {
+        pool.emplace_back([&worker, log]() {
+            LogScope scope(log);
+            worker();
+        });
+    }
+    worker();
+    for (auto &t : pool)
+        t.join();
+
+    if ( progress ) {
+        progress->end();
+        if ( progress->cancelled() )
+            return 1;
+    }
+
+    if (std::count(info.begin(), info.end(), 0) != static_cast<std::ptrdiff_t>(nc))
+        return 1;
+
+    log_stream() << "INFO: " << nc << " chromosome files written\n";
+
+    return 0;
+}
+
+std::unique_ptr<GenotypeSource> open_source(Format format, const std::string &filename, Progress *progress,
+                                            bool passthrough)
+{
+    std::unique_ptr<GenotypeSource> src;
+
+    if (format != Format::vcf && passthrough) {
+        log_stream() << "ERROR: passthrough is only supported for VCF input\n";
+        return nullptr;
+    }
+
+    if (format == Format::vcf)
+        src.reset(new VcfSource(filename, progress, passthrough));
+    else if (format == Format::hmp)
+        src.reset(new HmpSource(filename, progress));
+    else {
+        Genotype gt;
+        if (load_genotype(format, { filename }, gt, progress) != 0)
+            return nullptr;
+        src.reset(new MemorySource(std::move(gt)));
+    }
+
+    if ( src->error() )
+        return nullptr;
+
+    return src;
+}
+
+std::unique_ptr<GenotypeSink> open_sink(const std::string &filename, Format format, size_t memory)
+{
+    std::unique_ptr<GenotypeSink> sink;
+
+    if (format == Format::unknown)
+        format = format_of(filename);
+
+    switch (format) {
+    case Format::vcf:
+        sink.reset(new VcfSink(filename));
+        break;
+    case Format::hmp:
+        sink.reset(new HmpSink(filename));
+        break;
+    case Format::ped:
+        if (memory > 0) {
+            if (filename == "-") {
+                log_stream() << "ERROR: PED and MAP files can't be written to stdout\n";
+                break;
+            }
+            sink.reset(new PedSink(ped_prefix(filename), memory));
+            break;
+        }
+        // fall through
+    case Format::geno:
+        sink.reset(new BufferedSink([filename, format](const Genotype &gt) {
+            return write_genotype(gt, filename, format, nullptr);
+        }));
+        break;
+    default:
+        log_stream() << "ERROR: unrecognized output format: " << filename << "\n";
+        break;
+    }
+
+    return sink;
+}
+
+std::unique_ptr<ChrSplitSink> open_split_sink(const std::string &filename, Format format, size_t memory)
+{
+    if (format == Format::unknown)
+        format = format_of(filename);
+
+    if (format == Format::unknown) {
+        log_stream() << "ERROR: unrecognized output format: " << filename << "\n";
+        return nullptr;
+    }
+
+    if (filename == "-") {
+        log_stream() << "ERROR: chromosome files can't be written to stdout\n";
+        return nullptr;
+    }
+
+    return std::unique_ptr<ChrSplitSink>(new ChrSplitSink([filename, format, memory](const std::string &chr) {
+        return open_sink(chr_file_name(filename, chr), format, memory);
+    }, memory == 0));
+}
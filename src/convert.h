@@ -0,0 +1,92 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "vcf.h"
+#include "stream.h"
+
+
+// Conversion pipeline shared by the command line program and the GUI
+//
+//   Genotype gt;
+//   load_genotype(Format::vcf, { "chr1.vcf", "chr2.vcf" }, gt, &progress);
+//   sort_chrpos(gt, &progress);
+//   save_genotype(gt, "out.ped", &progress);
+//   save_genotype(gt, "out.hmp", &progress);
+//
+//   Loci can also be passed one at a time without holding the whole data set:
+//
+//   auto src = open_source(Format::vcf, "in.vcf");
+//   auto sink = open_sink("out.hmp");
+//   pump(*src, *sink);
+//
+//   open_split_sink("out.vcf") instead writes loci grouped by chromosome to out.<chr>.vcf.
+//
+//   There is no global state, a loaded genotype can be exported several times. Each
+//   stage reports to the optional progress monitor, and returns non-zero as soon as
+//   possible once Progress::cancel() has been called from another thread.
+//
+
+
+enum class Format { unknown, vcf, ped, hmp, geno };
+
+
+// format by file name suffix (.vcf/.ped/.hmp/.geno)
+Format format_of(const std::string &filename);
+
+// format by name: vcf, ped, hmp or geno
+Format parse_format(const std::string &name);
+
+// total size of the files of an input or output name, PED/MAP are counted together, 0 for stdin/stdout
+std::uint64_t genotype_file_size(const std::string &filename);
+
+// output file of a chromosome, prefix.ext -> prefix.<chr>.ext
+std::string chr_file_name(const std::string &filename, const std::string &chr);
+
+// 1 if the loci of a VCF or HapMap file are grouped by chromosome, 0 if a chromosome
+// reappears, -1 for other formats, stdin or a file that can't be mapped; only the
+// chromosome column is scanned
+int chr_grouped(Format format, const std::string &filename);
+
+// read genotype file(s), multiple VCF files are concatenated; VCF passthrough keeps the
+// input lines, which can then only be saved as VCF, see Genotype::raw. VCF and HapMap
+// are read from stdin if the file name is "-". Loci are counted into the summary while
+// they are parsed if one is given.
+int load_genotype(Format format, const std::vector<std::string> &filenames, Genotype &gt, Progress *progress = nullptr,
+                  bool passthrough = false, GenotypeSummary *summary = nullptr);
+
+// sort loci in ascending chromosome position order, loci of equal position keep input order
+void sort_chrpos(Genotype &gt, Progress *progress = nullptr);
+
+// write genotype in the given format, or that of the output file suffix if unknown;
+// the file name "-" is stdout
+int save_genotype(const Genotype &gt, const std::string &filename, Progress *progress = nullptr,
+                  Format format = Format::unknown);
+
+// write one output file per chromosome concurrently, see chr_file_name
+int save_genotype_by_chr(const Genotype &gt, const std::string &filename, Progress *progress = nullptr,
+                         Format format = Format::unknown);
+
+
+// record source of an input file, PED and the general genotype format are loaded as a whole
+std::unique_ptr<GenotypeSource> open_source(Format format, const std::string &filename, Progress *progress = nullptr,
+                                            bool passthrough = false);
+
+// record sink of an output file by format or suffix, PED and the general genotype format are
+// written at the end; PED is written by PedSink within memory bytes if memory is not 0
+std::unique_ptr<GenotypeSink> open_sink(const std::string &filename, Format format = Format::unknown,
+                                        std::size_t memory = 0);
+
+
+// record sink of one output file per chromosome, each opened as by open_sink; loci must be
+// grouped by chromosome, see ChrSplitSink and chr_file_name. Only without a memory limit
+// is a chromosome file written while the next chromosome is read
+std::unique_ptr<ChrSplitSink> open_split_sink(const std::string &filename, Format format = Format::unknown,
+                                              std::size_t memory = 0);
+
+
+#endif // CONVERT_H
@@ -1,12 +1,18 @@
+#include <cstdio>
+#include <memory>
 #include <string>
-#include <numeric>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <algorithm>
 #include "cmdline.h"
-#include "vcf.h"
-#include "ped.h"
-#include "hmp.h"
-#include "geno.h"
+#include "convert.h"
+#include "kernel.h"
+#include "mapfile.h"
+#include "number.h"
+#include "perf.h"
+#include "progress.h"
+#include "summary.h"
 #include "util.h"
 
 
@@ -26,42 +32,345 @@ struct Parameter
     std::string ped;
     std::string hmp;
     std::string geno;
+    std::string in;
+    std::string in_format;
     std::string out;
+    std::string out_format;
+    std::string stats_json;
+    std::string locus_stats;
+    std::string sample_stats;
+    std::string maf;
+    std::string max_missing;
+    std::string memory_limit;
+    std::uint64_t memory = 0;
+    bool drop_monomorphic = false;
     bool sort = false;
+    bool split_by_chr = false;
+    bool passthrough = false;
+    bool stats = false;
+    bool progress = false;
 } par;
 
 
-void sort_chrpos(Genotype &gt)
+struct Stage
 {
-    auto chr = unique(gt.chr);
+    std::string name;
+    std::uint64_t bytes_in = 0;
+    std::uint64_t bytes_out = 0;
+    std::uint64_t records = 0;
+    std::uint64_t rss = 0;
+    double wall = 0.0;
+    double cpu = 0.0;
+};
 
-    auto m = gt.loc.size();
-    std::vector<size_t> z;
-    z.reserve(m);
 
-    for (auto &e : chr) {
-        std::vector<size_t> idx;
-        for (size_t i = 0; i < m; ++i) {
-            if (gt.chr[i] == e)
-                idx.push_back(i);
+// bytes, optionally with a K, M or G suffix
+bool parse_memory(const std::string &s, std::uint64_t &x)
+{
+    auto n = s.size();
+    int shift = 0;
+
+    if (n > 1) {
+        switch (s.back()) {
+        case 'K': case 'k': shift = 10; break;
+        case 'M': case 'm': shift = 20; break;
+        case 'G': case 'g': shift = 30; break;
         }
+        if (shift != 0)
+            --n;
+    }
+
+    std::int64_t v = 0;
+    if ( ! parse_integer(s.data(), n, v) || v <= 0 || v >= (std::int64_t(1) << (62 - shift)) )
+        return false;
+
+    x = static_cast<std::uint64_t>(v) << shift;
+
+    return true;
+}
+
+void stage_begin(Stage &st, const std::string &name)
+{
+    reset_peak_rss();
+    st.name = name;
+    st.wall = wall_time();
+    st.cpu = cpu_time();
+}
+
+void stage_end(Stage &st)
+{
+    st.wall = wall_time() - st.wall;
+    st.cpu = cpu_time() - st.cpu;
+    st.rss = peak_rss();
+}
+
+void print_stats(const std::vector<Stage> &stages)
+{
+    std::cerr << "STATS: stage\twall_s\tcpu_s\tbytes_in\tbytes_out\trecords\trecords/s\tMB/s\tpeak_rss_MB\n";
+
+    for (auto &st : stages) {
+        auto rps = st.wall > 0 ? st.records / st.wall : 0.0;
+        auto mbs = st.wall > 0 ? std::max(st.bytes_in, st.bytes_out) / 1e6 / st.wall : 0.0;
+        std::cerr << "STATS: " << st.name << std::fixed << std::setprecision(3) << "\t" << st.wall << "\t" << st.cpu
+                  << "\t" << st.bytes_in << "\t" << st.bytes_out << "\t" << st.records << "\t" << std::setprecision(0)
+                  << rps << "\t" << std::setprecision(3) << mbs << "\t" << std::setprecision(1) << st.rss / 1048576.0
+                  << "\n" << std::defaultfloat;
+    }
+}
+
+int write_stats_json(const std::vector<Stage> &stages, const std::string &filename)
+{
+    std::ofstream ofs(filename);
+    if ( ! ofs ) {
+        std::cerr << "ERROR: can't open file for writing: " << filename << "\n";
+        return 1;
+    }
+
+    ofs << "{\n  \"version\": \"" GCONV_VERSION "\",\n  \"kernel\": \"" << kernel().isa << "\",\n  \"stages\": [";
+
+    for (size_t k = 0; k < stages.size(); ++k) {
+        auto &st = stages[k];
+        auto rps = st.wall > 0 ? st.records / st.wall : 0.0;
+        ofs << (k == 0 ? "\n" : ",\n") << "    { \"stage\": \"" << st.name << "\", \"wall_s\": " << st.wall
+            << ", \"cpu_s\": " << st.cpu << ", \"bytes_in\": " << st.bytes_in << ", \"bytes_out\": " << st.bytes_out
+            << ", \"records\": " << st.records << ", \"records_per_s\": " << rps << ", \"peak_rss\": " << st.rss << " }";
+    }
+
+    ofs << "\n  ]\n}\n";
+
+    return 0;
+}
+
+// the data lines of a mapped VCF file are indexed and sorted without decoding genotypes
+int index_sorted_vcf(const MappedFile &in, VcfIndex &idx, std::vector<Stage> &stages, Progress *prog)
+{
+    Stage st;
+
+    stage_begin(st, "read");
+    if ( prog )
+        prog->begin("read", in.size());
+
+    int info = index_vcf(in.data(), in.size(), idx, prog);
+
+    if ( prog ) {
+        prog->end();
+        if ( prog->cancelled() )
+            info = 1;
+    }
+
+    if (info != 0)
+        return 1;
+
+    stage_end(st);
+    st.records = idx.line.size();
+    st.bytes_in = in.size();
+    stages.push_back(st);
+
+    st = Stage();
+    stage_begin(st, "sort");
+    if ( prog )
+        prog->begin("sort", 0, idx.line.size());
+
+    sort_vcf_index(idx, prog);
+
+    if ( prog )
+        prog->end();
+    stage_end(st);
+    st.records = idx.line.size();
+    stages.push_back(st);
 
-        auto pos = subset(gt.pos, idx);
-        if ( ! std::is_sorted(pos.begin(), pos.end()) ) {
-            auto ord = order(pos);
-            subset(idx,ord).swap(idx);
+    return 0;
+}
+
+// --passthrough --sort of one VCF file: the lines of the mapped input are indexed and
+// copied in sorted order, no genotype is decoded; -1 if the file can't be mapped. Sorting
+// a file onto itself writes a temporary file next to it, which then replaces the input.
+int sort_vcf_file(const std::string &filename, std::vector<Stage> &stages, Progress *prog)
+{
+    std::unique_ptr<MappedFile> map(new MappedFile(filename));
+    if ( ! *map )
+        return -1;
+
+    auto &in = *map;
+
+    VcfIndex idx;
+    if (index_sorted_vcf(in, idx, stages, prog) != 0)
+        return 1;
+
+    std::cerr << "INFO: " << idx.ind.size() << " individuals, " << idx.line.size() << " loci\n";
+
+    if (idx.ind.empty() && idx.line.empty())
+        return 1;
+
+    Stage st;
+    stage_begin(st, "write");
+    if ( prog )
+        prog->begin("write", 0, idx.line.size());
+
+    std::string out = par.out;
+
+    if ( same_file(filename, par.out) ) {
+        out = make_temp_file(par.out);
+        if ( out.empty() ) {
+            std::cerr << "ERROR: can't create temporary file for: " << par.out << "\n";
+            return 1;
         }
+    }
 
-        z.insert(z.end(), idx.begin(), idx.end());
+    int info = write_vcf_index(in.data(), idx, out, prog);
+
+    if ( prog ) {
+        prog->end();
+        if ( prog->cancelled() )
+            info = 1;
     }
 
-    subset(gt.loc,z).swap(gt.loc);
-    subset(gt.chr,z).swap(gt.chr);
-    subset(gt.pos,z).swap(gt.pos);
-    subset(gt.dat,z).swap(gt.dat);
-    subset(gt.allele,z).swap(gt.allele);
+    if (out != par.out) {
+        // the mapping is released first, a mapped file can't be replaced on Windows
+        map.reset();
+        if (info == 0 && ! replace_file(out, par.out)) {
+            std::cerr << "ERROR: can't replace file: " << par.out << "\n";
+            info = 1;
+        }
+        if (info != 0)
+            std::remove(out.c_str());
+    }
+
+    if (info != 0)
+        return 1;
+
+    stage_end(st);
+    st.records = idx.line.size();
+    st.bytes_out = genotype_file_size(par.out);
+    stages.push_back(st);
+
+    return 0;
 }
 
+// a single input is passed to the output one locus at a time, VCF and HapMap are never
+// held in memory as a whole; --split-by-chr requires the loci grouped by chromosome then.
+// With --sort, a VCF file is mapped and its loci are decoded in the order of the sorted
+// index of its lines; -1 if the file can't be mapped.
+int stream_genotype(Format format, const std::string &filename, Format out_format, std::vector<Stage> &stages,
+                    Progress *prog, GenotypeSummary *summary)
+{
+    std::unique_ptr<MappedFile> map;
+    VcfIndex idx;
+
+    if ( par.sort ) {
+        map.reset(new MappedFile(filename));
+        if ( ! *map )
+            return -1;
+        if (index_sorted_vcf(*map, idx, stages, prog) != 0)
+            return 1;
+    }
+
+    Stage st;
+
+    stage_begin(st, "convert");
+    if ( prog )
+        prog->begin("convert", genotype_file_size(filename));
+
+    std::unique_ptr<GenotypeSource> src;
+    if ( map )
+        src.reset(new VcfIndexSource(map->data(), idx, prog));
+    else
+        src = open_source(format, filename, prog, par.passthrough);
+
+    std::unique_ptr<GenotypeSink> sink;
+    ChrSplitSink *split = nullptr;
+
+    if ( par.split_by_chr ) {
+        auto p = open_split_sink(par.out, out_format, static_cast<size_t>(par.memory));
+        split = p.get();
+        sink = std::move(p);
+    }
+    else
+        sink = open_sink(par.out, out_format, static_cast<size_t>(par.memory));
+
+    std::uint64_t count = 0;
+    int info = src && sink ? pump(*src, *sink, &count, summary) : 1;
+
+    if ( prog ) {
+        prog->end();
+        if ( prog->cancelled() )
+            info = 1;
+    }
+
+    if (info != 0)
+        return 1;
+
+    stage_end(st);
+    st.records = count;
+    st.bytes_in = genotype_file_size(filename);
+    if ( split ) {
+        for (auto &e : split->chromosomes())
+            st.bytes_out += genotype_file_size(chr_file_name(par.out, e));
+    }
+    else
+        st.bytes_out = genotype_file_size(par.out);
+    stages.push_back(st);
+
+    std::cerr << "INFO: " << src->samples().size() << " individuals, " << count << " loci\n";
+
+    if ( split )
+        std::cerr << "INFO: " << split->chromosomes().size() << " chromosome files written\n";
+
+    return 0;
+}
+
+int convert_genotype(Format format, const std::vector<std::string> &filenames, Format out_format,
+                     std::vector<Stage> &stages, Progress *prog, GenotypeSummary *summary)
+{
+    Genotype gt;
+    Stage st;
+
+    stage_begin(st, "read");
+
+    if (load_genotype(format, filenames, gt, prog, par.passthrough, summary) != 0)
+        return 1;
+
+    stage_end(st);
+    st.records = gt.loc.size();
+    for (auto &e : filenames)
+        st.bytes_in += genotype_file_size(e);
+    stages.push_back(st);
+
+    std::cerr << "INFO: " << gt.ind.size() << " individuals, " << gt.loc.size() << " loci\n";
+
+    if (gt.ind.empty() && gt.loc.empty())
+        return 1;
+
+    if (par.sort) {
+        st = Stage();
+        stage_begin(st, "sort");
+        sort_chrpos(gt, prog);
+        stage_end(st);
+        st.records = gt.loc.size();
+        stages.push_back(st);
+    }
+
+    st = Stage();
+    stage_begin(st, "write");
+
+    if ( par.split_by_chr ) {
+        if (save_genotype_by_chr(gt, par.out, prog, out_format) != 0)
+            return 1;
+        for (auto &e : stable_unique(gt.chr))
+            st.bytes_out += genotype_file_size(chr_file_name(par.out, e));
+    }
+    else {
+        if (save_genotype(gt, par.out, prog, out_format) != 0)
+            return 1;
+        st.bytes_out = genotype_file_size(par.out);
+    }
+
+    stage_end(st);
+    st.records = gt.loc.size();
+    stages.push_back(st);
+
+    return 0;
+}
 
 } // namespace
 
@@ -72,12 +381,27 @@ int gconv(int argc, char *argv[])
 
     CmdLine cmd;
 
-    cmd.add("--vcf", "VCF genotype file", "");
+    cmd.add("--vcf", "VCF genotype file(s), multiple files are concatenated", "");
     cmd.add("--ped", "PLINK ped file (map file has same basename)", "");
     cmd.add("--hmp", "HapMap genotype file", "");
     cmd.add("--geno", "General genotype file", "");
-    cmd.add("--out", "output file with format suffix (.vcf/.ped/.hmp/.geno)", "");
+    cmd.add("--in", "input genotype file(s) of --in-format or by suffix, - for stdin", "");
+    cmd.add("--in-format", "input format: vcf, ped, hmp or geno", "");
+    cmd.add("--out", "output file with format suffix (.vcf/.ped/.hmp/.geno), - for stdout", "");
+    cmd.add("--out-format", "output format: vcf, ped, hmp or geno, overrides the suffix", "");
     cmd.add("--sort", "sorting loci in ascending chromosome position order");
+    cmd.add("--split-by-chr", "write one output file per chromosome, prefix.<chr>.<ext>");
+    cmd.add("--passthrough", "copy VCF lines to VCF output unchanged, genotypes are not decoded");
+    cmd.add("--locus-stats", "write allele frequencies, missing rate and heterozygosity of each locus (TSV)", "");
+    cmd.add("--freq", "same as --locus-stats", "");
+    cmd.add("--sample-stats", "write missing rate of each sample (TSV)", "");
+    cmd.add("--maf", "remove loci of minor allele frequency below this", "");
+    cmd.add("--max-missing", "remove loci of missing genotype rate above this", "");
+    cmd.add("--drop-monomorphic", "remove loci of fewer than two called alleles");
+    cmd.add("--memory-limit", "write PED output through temporary files within this memory, e.g. 512M or 4G; a single input, with --sort a VCF file", "");
+    cmd.add("--stats", "report time, throughput and memory of each stage");
+    cmd.add("--stats-json", "write per stage statistics to a JSON file", "");
+    cmd.add("--progress", "periodically report progress of each stage to stderr");
 
     cmd.parse(argc, argv);
 
@@ -90,62 +414,177 @@ int gconv(int argc, char *argv[])
     par.ped = cmd.get("--ped");
     par.hmp = cmd.get("--hmp");
     par.geno = cmd.get("--geno");
+    par.in = cmd.get("--in");
+    par.in_format = cmd.get("--in-format");
     par.out = cmd.get("--out");
+    par.out_format = cmd.get("--out-format");
     par.sort = cmd.has("--sort");
+    par.split_by_chr = cmd.has("--split-by-chr");
+    par.passthrough = cmd.has("--passthrough");
+    par.stats = cmd.has("--stats");
+    par.stats_json = cmd.get("--stats-json");
+    par.locus_stats = cmd.get("--locus-stats");
+    if ( par.locus_stats.empty() )
+        par.locus_stats = cmd.get("--freq");
+    par.sample_stats = cmd.get("--sample-stats");
+    par.maf = cmd.get("--maf");
+    par.max_missing = cmd.get("--max-missing");
+    par.drop_monomorphic = cmd.has("--drop-monomorphic");
+    par.memory_limit = cmd.get("--memory-limit");
+    par.progress = cmd.has("--progress");
 
-    Genotype gt;
+    std::vector<Stage> stages;
+
+    Progress progress([](const Progress &p) { std::cerr << p.format() << std::endl; });
+    auto prog = par.progress ? &progress : nullptr;
 
     std::cerr << "INFO: reading genotype file...\n";
 
+    auto format = Format::unknown;
+    std::vector<std::string> filenames;
+
     if ( ! par.vcf.empty() ) {
-        if (read_vcf(par.vcf, gt) != 0)
-            return 1;
+        format = Format::vcf;
+        filenames = split(par.vcf, ",");
     }
     else if ( ! par.ped.empty() ) {
-        auto prefix = par.ped;
-        if (ends_with(prefix, ".ped"))
-            prefix = prefix.substr(0, prefix.size() - 4);
-        if (read_ped(prefix, gt) != 0)
-            return 1;
+        format = Format::ped;
+        filenames.push_back(ends_with(par.ped, ".ped") ? par.ped : par.ped + ".ped");
     }
     else if ( ! par.hmp.empty() ) {
-        if (read_hmp(par.hmp, gt) != 0)
-            return 1;
+        format = Format::hmp;
+        filenames.push_back(par.hmp);
     }
     else if ( ! par.geno.empty() ) {
-        if (read_geno(par.geno, gt) != 0)
+        format = Format::geno;
+        filenames.push_back(par.geno);
+    }
+    else if ( ! par.in.empty() ) {
+        filenames = split(par.in, ",");
+        format = par.in_format.empty() ? format_of(filenames[0]) : parse_format(par.in_format);
+        if (format == Format::unknown) {
+            std::cerr << "ERROR: unrecognized input format, use --in-format: " << par.in << "\n";
             return 1;
+        }
     }
 
-    std::cerr << "INFO: " << gt.ind.size() << " individuals, " << gt.loc.size() << " loci\n";
+    // the files of a list are opened more than once, stdin can be read only once
+    if (filenames.size() > 1 && std::count(filenames.begin(), filenames.end(), "-") > 0) {
+        std::cerr << "ERROR: stdin (-) can't be one of several input files\n";
+        return 1;
+    }
 
-    if (gt.ind.empty() && gt.loc.empty())
+    auto out_format = par.out_format.empty() ? format_of(par.out) : parse_format(par.out_format);
+    if (out_format == Format::unknown) {
+        std::cerr << "ERROR: unrecognized output format, use --out-format: " << par.out << "\n";
+        return 1;
+    }
+
+    if (par.passthrough && (format != Format::vcf || out_format != Format::vcf)) {
+        std::cerr << "ERROR: --passthrough requires VCF input and output\n";
         return 1;
+    }
 
-    if (par.sort)
-        sort_chrpos(gt);
+    LocusFilter filter;
 
-    if ( ends_with(par.out, ".vcf") ) {
-        if (write_vcf(gt, par.out) != 0)
-            return 1;
+    if ( ! par.maf.empty() && (! parse_double(par.maf.data(), par.maf.size(), filter.maf)
+                               || filter.maf < 0 || filter.maf > 0.5) ) {
+        std::cerr << "ERROR: --maf must be a number in [0, 0.5]: " << par.maf << "\n";
+        return 1;
     }
-    else if ( ends_with(par.out, ".ped") ) {
-        auto prefix = par.out.substr(0, par.out.size() - 4);
-        if (write_ped(gt, prefix) != 0)
-            return 1;
+
+    if ( ! par.max_missing.empty() && (! parse_double(par.max_missing.data(), par.max_missing.size(),
+                                                      filter.max_missing)
+                                       || filter.max_missing < 0 || filter.max_missing > 1) ) {
+        std::cerr << "ERROR: --max-missing must be a number in [0, 1]: " << par.max_missing << "\n";
+        return 1;
     }
-    else if ( ends_with(par.out, ".hmp") ) {
-        if (write_hmp(gt, par.out) != 0)
-            return 1;
+
+    filter.drop_monomorphic = par.drop_monomorphic;
+
+    if ( ! par.memory_limit.empty() && ! parse_memory(par.memory_limit, par.memory) ) {
+        std::cerr << "ERROR: --memory-limit must be a size such as 512M or 4G: " << par.memory_limit << "\n";
+        return 1;
     }
-    else if ( ends_with(par.out, ".geno") ) {
-        if (write_geno(gt, par.out) != 0)
+
+    // counted and filtered while the input is parsed, passthrough doesn't decode genotypes
+    GenotypeSummary summary;
+    GenotypeSummary *sum = nullptr;
+
+    if ( ! par.locus_stats.empty() || ! par.sample_stats.empty() || filter.active() ) {
+        if ( par.passthrough ) {
+            std::cerr << "ERROR: --locus-stats, --sample-stats and locus filters can't be used with --passthrough\n";
             return 1;
+        }
+        if (summary.open(par.locus_stats, par.sample_stats) != 0)
+            return 1;
+        summary.set_filter(filter);
+        sum = &summary;
     }
-    else {
-        std::cerr << "ERROR: unrecognized output format: " << par.out << "\n";
+
+    int info = -1;
+
+    bool single = filenames.size() == 1 && ! par.sort;
+    bool piped = std::count(filenames.begin(), filenames.end(), "-") > 0 || par.out == "-";
+
+    // PED and the general format are loaded by their source anyway, split them in any order from memory
+    bool streamed = format == Format::vcf || format == Format::hmp;
+
+    // a sorted VCF file is streamed in the order of the sorted index of its lines
+    bool indexed = filenames.size() == 1 && par.sort && format == Format::vcf && filenames[0] != "-"
+                   && ! par.passthrough;
+
+    // a memory limit streams PED output, which is transposed out of core
+    if (par.memory > 0 && ! single && ! indexed) {
+        std::cerr << "ERROR: --memory-limit requires a single input, with --sort a VCF file\n";
+        return 1;
+    }
+
+    // a split is streamed if a scan finds the loci grouped by chromosome, otherwise the
+    // chromosome files are written from the loaded loci; a memory limit always streams
+    if (single && par.split_by_chr && streamed && par.memory == 0) {
+        streamed = chr_grouped(format, filenames[0]) == 1;
+        if ( ! streamed && filenames[0] != "-" )
+            std::cerr << "INFO: loci are not grouped by chromosome, the input is loaded\n";
+    }
+
+    if (par.passthrough && par.sort && ! par.split_by_chr && filenames.size() == 1 && filenames[0] != "-")
+        info = sort_vcf_file(filenames[0], stages, prog);
+    else if ((single && (par.split_by_chr ? streamed : piped || (par.memory > 0 && out_format == Format::ped)))
+             || (indexed && par.memory > 0))
+        info = stream_genotype(format, filenames[0], out_format, stages, prog, sum);
+
+    if (info < 0)
+        info = convert_genotype(format, filenames, out_format, stages, prog, sum);
+
+    if (info != 0)
+        return 1;
+
+    if (sum && filter.active())
+        std::cerr << "INFO: " << sum->rejected() << " loci removed by filters\n";
+
+    if (sum && sum->end() != 0)
         return 1;
+
+    if (par.stats || ! par.stats_json.empty()) {
+        Stage total;
+        total.name = "total";
+        for (auto &e : stages) {
+            total.wall += e.wall;
+            total.cpu += e.cpu;
+            total.rss = std::max(total.rss, e.rss);
+        }
+        total.bytes_in = stages.front().bytes_in;
+        total.bytes_out = stages.back().bytes_out;
+        total.records = stages.back().records;
+        stages.push_back(total);
     }
 
+    if ( par.stats )
+        print_stats(stages);
+
+    if ( ! par.stats_json.empty() && write_stats_json(stages, par.stats_json) != 0 )
+        return 1;
+
     return 0;
 }
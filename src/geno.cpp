@@ -1,8 +1,12 @@
-#include <fstream>
 #include <iostream>
 #include <algorithm>
 #include "geno.h"
 #include "split.h"
+#include "number.h"
+#include "lineio.h"
+#include "log.h"
+#include "progress.h"
+#include "summary.h"
 
 
 using std::size_t;
@@ -10,18 +14,65 @@ using std::size_t;
 
 namespace {
 
-template<typename T1, typename T2>
-size_t index(const std::vector<T1> &v, const T2 &a)
+// alleles of a locus in a hash table, codes in order of first occurrence; the table is
+// reused from locus to locus
+class AlleleDict
 {
-    size_t i = 0, n = v.size();
+public:
+    AlleleDict() : slot_(16, 0) {}
+
+    // code of allele a, added if new
+    std::uint32_t insert(const Token &a)
+    {
+        auto mask = slot_.size() - 1;
+
+        for (auto i = hash(a) & mask; ; i = (i + 1) & mask) {
+            auto c = slot_[i];
+            if (c == 0) {
+                keys_.push_back(a);
+                slot_[i] = static_cast<std::uint32_t>(keys_.size());
+                if (keys_.size() * 2 > slot_.size())
+                    grow();
+                return static_cast<std::uint32_t>(keys_.size() - 1);
+            }
+            if (keys_[c-1] == a)
+                return c - 1;
+        }
+    }
+
+    const std::vector<Token>& keys() const { return keys_; }
 
-    for (i = 0; i < n; ++i) {
-        if (v[i] == a)
-            break;
+    void clear()
+    {
+        keys_.clear();
+        slot_.assign(16, 0);
     }
 
-    return i;
-}
+private:
+    static size_t hash(const Token &a)
+    {
+        std::uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < a.size(); ++i)
+            h = (h ^ static_cast<unsigned char>(a[i])) * 1099511628211ULL;
+        return static_cast<size_t>(h);
+    }
+
+    void grow()
+    {
+        slot_.assign(slot_.size() * 2, 0);
+        auto mask = slot_.size() - 1;
+        for (size_t k = 0; k < keys_.size(); ++k) {
+            auto i = hash(keys_[k]) & mask;
+            while (slot_[i] != 0)
+                i = (i + 1) & mask;
+            slot_[i] = static_cast<std::uint32_t>(k + 1);
+        }
+    }
+
+private:
+    std::vector<std::uint32_t> slot_;   // code + 1, 0 if empty
+    std::vector<Token> keys_;
+};
 
 // http://www.chem.qmul.ac.uk/iubmb/misc/naseq.html
 //
@@ -33,137 +84,184 @@ size_t index(const std::vector<T1> &v, const T2 &a)
 //   Y --- C/T
 //
 
-char encode_iupac(char a, char b)
+// classes of genotype characters, OR-ed over a file while it is read
+enum GenoClass { GENO_BASE = 1, GENO_AMBIGUOUS = 2, GENO_MISSING = 4, GENO_OTHER = 8 };
+
+struct IupacTables
 {
-    if (a == b && (a == 'A' || a == 'C' || a == 'G' || a == 'T'))
-        return a;
+    std::uint8_t base[256];     // A, C, G, T to 0-3, others to 15
+    char code[16*16];           // IUPAC code of a pair of bases, N if none
+    char pair[256][2];          // bases of an IUPAC code, 0 if none
+    std::uint8_t cls[256];      // GenoClass of a character
+    allele_t input[256];        // missing codes to 0, others unchanged
+
+    IupacTables()
+    {
+        static const char * const z[] = { "AAA", "CCC", "GGG", "TTT", "WAT", "SCG", "MAC", "KGT", "RAG", "YCT" };
+
+        std::fill(base, base + 256, 15);
+        std::fill(code, code + 16*16, 'N');
+        std::fill(&pair[0][0], &pair[0][0] + 512, 0);
+        std::fill(cls, cls + 256, GENO_OTHER);
+
+        for (auto e : z) {
+            auto c = static_cast<unsigned char>(e[0]);
+            pair[c][0] = e[1];
+            pair[c][1] = e[2];
+            cls[c] = e[1] == e[2] ? GENO_BASE : GENO_AMBIGUOUS;
+        }
 
-    if (a > b)
-        std::swap(a, b);
+        for (int k = 0; k < 4; ++k)
+            base[static_cast<unsigned char>("ACGT"[k])] = static_cast<std::uint8_t>(k);
 
-    if (a == 'A') {
-        if (b == 'C') return 'M';
-        if (b == 'G') return 'R';
-        if (b == 'T') return 'W';
-    }
+        for (auto e : z) {
+            auto a = base[static_cast<unsigned char>(e[1])], b = base[static_cast<unsigned char>(e[2])];
+            code[a*16+b] = code[b*16+a] = e[0];
+        }
 
-    if (a == 'C') {
-        if (b == 'G') return 'S';
-        if (b == 'T') return 'Y';
+        for (int c = 0; c < 256; ++c)
+            input[c] = static_cast<allele_t>(c);
+
+        for (auto c : { 'N', '-', '.', '?' }) {
+            input[static_cast<unsigned char>(c)] = 0;
+            cls[static_cast<unsigned char>(c)] = GENO_MISSING;
+        }
     }
+};
 
-    if (a == 'G' && b == 'T')
-        return 'K';
+const IupacTables iupac;
 
-    return 'N';
+char encode_iupac(char a, char b)
+{
+    return iupac.code[iupac.base[static_cast<unsigned char>(a)] * 16 + iupac.base[static_cast<unsigned char>(b)]];
 }
 
-std::pair<char, char> decode_iupac(char c)
-{
-    char a = 0, b = 0;
+// genotype coding of a file, in order of precedence; ploidy is a compile-time constant
+// except for homozygous and polyploid genotypes
+enum GenoCoding { GENO_HAPLOID, GENO_IUPAC, GENO_HOMOZYGOUS, GENO_DIPLOID, GENO_POLYPLOID };
 
-    if (c == 'A' || c == 'C' || c == 'G' || c == 'T')
-        a = b = c;
-    else if (c == 'W') {
-        a = 'A';
-        b = 'T';
-    }
-    else if (c == 'S') {
-        a = 'C';
-        b = 'G';
-    }
-    else if (c == 'M') {
-        a = 'A';
-        b = 'C';
-    }
-    else if (c == 'K') {
-        a = 'G';
-        b = 'T';
-    }
-    else if (c == 'R') {
-        a = 'A';
-        b = 'G';
-    }
-    else if (c == 'Y') {
-        a = 'C';
-        b = 'T';
+// single character codes, fixed width output; IUPAC codes are indexed by a*stride+b
+template<GenoCoding C>
+void append_geno_chars(const allele_t *dat, size_t n, size_t ploidy, const char *codes, size_t stride, std::string &line)
+{
+    const size_t w = C == GENO_DIPLOID ? 4 : C == GENO_POLYPLOID ? ploidy * 2 : 2;
+
+    auto k = line.size();
+    line.resize(k + w * n);
+    auto p = &line[k];
+
+    for (size_t i = 0; i < n; ++i, p += w) {
+        p[0] = '\t';
+        if (C == GENO_HAPLOID)
+            p[1] = codes[dat[i]];
+        else if (C == GENO_IUPAC)
+            p[1] = codes[dat[i*2] * stride + dat[i*2+1]];
+        else if (C == GENO_HOMOZYGOUS)
+            p[1] = codes[dat[i*ploidy]];
+        else if (C == GENO_DIPLOID) {
+            p[1] = codes[dat[i*2]];
+            p[2] = '/';
+            p[3] = codes[dat[i*2+1]];
+        }
+        else {
+            for (size_t k = 0; k < ploidy; ++k) {
+                p[k*2] = '/';
+                p[k*2+1] = codes[dat[i*ploidy+k]];
+            }
+            p[0] = '\t';
+        }
     }
-
-    return { a, b };
 }
 
-bool is_iupac(const std::vector< std::vector<allele_t> > &dat)
+template<GenoCoding C>
+void append_geno_strings(const allele_t *dat, size_t n, size_t ploidy, const std::string *codes, std::string &line)
 {
-    bool ret = false;
-
-    for (auto &v : dat) {
-        for (auto &a : v) {
-            switch (a) {
-            case 'A': case 'C': case 'G': case 'T': case 0:
-                break;
-            case 'W': case 'S': case 'M': case 'K': case 'R': case 'Y':
-                ret = true;
-                break;
-            default:
-                return false;
-            }
+    for (size_t i = 0; i < n; ++i) {
+        line.push_back('\t');
+        if (C == GENO_HAPLOID)
+            line.append(codes[dat[i]]);
+        else if (C == GENO_HOMOZYGOUS)
+            line.append(codes[dat[i*ploidy]]);
+        else if (C == GENO_DIPLOID)
+            line.append(codes[dat[i*2]]).append("/").append(codes[dat[i*2+1]]);
+        else {
+            line.append(codes[dat[i*ploidy]]);
+            for (size_t k = 1; k < ploidy; ++k)
+                line.append("/").append(codes[dat[i*ploidy+k]]);
         }
     }
-
-    return ret;
 }
 
-int check_compat_iupac(const Genotype &gt)
+// loci of 16-bit allele codes
+template<GenoCoding C>
+void append_geno_wide(const std::vector<allele_t> &dat, size_t n, size_t ploidy, const std::string *codes, std::string &line)
 {
-    for (auto &v : gt.allele) {
-        for (auto &e : v) {
-            if (e.size() != 1)
-                return 1;
-            auto a = e[0];
-            if (a != 'A' && a != 'C' && a != 'G' && a != 'T')
-                return 2;
+    for (size_t i = 0; i < n; ++i) {
+        line.push_back('\t');
+        line.append(codes[get_allele(dat, i*ploidy, 2)]);
+        if (C != GENO_HOMOZYGOUS) {
+            for (size_t k = 1; k < ploidy; ++k)
+                line.append("/").append(codes[get_allele(dat, i*ploidy+k, 2)]);
         }
     }
-
-    return 0;
 }
 
-int check_homozygous(const Genotype &gt)
+// code tables of a locus, index 0 is missing
+template<GenoCoding C>
+void append_geno_locus(const std::vector<allele_t> &dat, const AlleleList &as, size_t n, size_t ploidy,
+                       const std::string &missing, std::string &cc, std::vector<std::string> &sc, std::string &line)
 {
-    if (gt.ploidy != 2)
-        return 0;
-
-    auto n = gt.ind.size();
-
-    for (auto &v : gt.dat) {
-        for (size_t i = 0; i < n; ++i) {
-            if (v[i*2] != v[i*2+1])
-                return 1;
+    auto na = as.size();
+
+    if (C == GENO_IUPAC) {
+        auto stride = na + 1;
+        cc.assign(stride * stride, missing[0]);
+        for (size_t a = 1; a <= na; ++a) {
+            for (size_t b = 1; b <= na; ++b)
+                cc[a * stride + b] = encode_iupac(as[a-1][0], as[b-1][0]);
         }
+        append_geno_chars<C>(dat.data(), n, 2, cc.data(), stride, line);
+        return;
     }
 
-    return 0;
+    if (allele_width(na) != 1) {
+        sc.assign(1, missing);
+        sc.insert(sc.end(), as.begin(), as.end());
+        append_geno_wide<C>(dat, n, ploidy, sc.data(), line);
+        return;
+    }
+
+    bool single = std::all_of(as.begin(), as.end(), [](const std::string &e) { return e.size() == 1; });
+
+    if ( single ) {
+        cc.assign(1, missing[0]);
+        for (auto &e : as)
+            cc.push_back(e[0]);
+        append_geno_chars<C>(dat.data(), n, ploidy, cc.data(), 0, line);
+    }
+    else {
+        sc.assign(1, missing);
+        sc.insert(sc.end(), as.begin(), as.end());
+        append_geno_strings<C>(dat.data(), n, ploidy, sc.data(), line);
+    }
 }
 
-int read_genotype_char(const std::string &filename, Genotype &gt)
+int read_genotype_char(const std::string &filename, Genotype &gt, Progress *progress, GenotypeSummary *summary)
 {
-    std::ifstream ifs(filename);
+    LineReader ifs(filename, progress);
     if ( ! ifs ) {
-        std::cerr << "ERROR: can't open file for reading: " << filename << "\n";
+        log_stream() << "ERROR: can't open file for reading: " << filename << "\n";
         return 1;
     }
 
-    for (std::string line; std::getline(ifs, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
-
+    for (std::string line; ifs.getline(line); ) {
         std::vector<std::string> vs;
         split(line, " \t", vs);
         if ( vs.empty() )
             continue;
 
         if (vs.size() < 3) {
-            std::cerr << "ERROR: expected at least 3 columns at the first line\n";
+            log_stream() << "ERROR: expected at least 3 columns at the first line\n";
             return 1;
         }
 
@@ -174,10 +272,10 @@ int read_genotype_char(const std::string &filename, Genotype &gt)
     size_t ploidy = 0;
     auto n = gt.ind.size();
 
-    for (std::string line; std::getline(ifs, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
+    // classes of all characters, IUPAC codes are detected without another scan
+    std::uint8_t seen = 0;
 
+    for (std::string line; ifs.getline(line); ) {
         std::vector<Token> vt;
         split(line, " \t/:", vt);
         if ( vt.empty() )
@@ -185,90 +283,150 @@ int read_genotype_char(const std::string &filename, Genotype &gt)
 
         if (ploidy == 0) {
             ploidy = vt.size() > (3 + n) ? (vt.size() - 3) / n : 1;
-            if (ploidy > 2) {
-                std::cerr << "ERROR: polyploidy (" << ploidy << ") genotype is not supported: "
-                          << vt[0].to_string() << "\n";
-                return 1;
-            }
         }
 
         if (vt.size() != 3 + ploidy * n) {
-            std::cerr << "ERROR: column count doesn't match (" << vt.size() << " != "
+            log_stream() << "ERROR: column count doesn't match at line " << ifs.line_number() << " (" << vt.size() << " != "
                       << 3 + ploidy * n << "): " << vt[0].to_string() << "\n";
             return 1;
         }
 
+        pos_t pos = 0;
+        if ( ! parse_integer(vt[2], pos) ) {
+            log_stream() << "ERROR: invalid position at line " << ifs.line_number() << ": " << vt[2].to_string() << "\n";
+            return 1;
+        }
+
         gt.loc.push_back(vt[0].to_string());
         gt.chr.push_back(vt[1].to_string());
-        gt.pos.push_back(std::stoi(vt[2].to_string()));
+        gt.pos.push_back(pos);
 
-        std::vector<allele_t> v;
-        for (auto itr = vt.begin() + 3; itr != vt.end(); ++itr) {
-            if (itr->size() == 1)
-                v.push_back( static_cast<allele_t>( (*itr)[0] ) );
-            else
+        std::vector<allele_t> v(vt.size() - 3);
+        for (size_t i = 0; i < v.size(); ++i) {
+            auto &t = vt[i+3];
+            if (t.size() != 1)
                 return -1;
-        }
-
-        for (auto &e : v) {
-            if (e == 'N' || e == '-' || e == '.' || e == '?')
-                e = 0;
+            auto c = static_cast<unsigned char>(t[0]);
+            seen |= iupac.cls[c];
+            v[i] = iupac.input[c];
         }
 
         gt.dat.push_back(v);
     }
 
-    bool iupac = ploidy == 1 && is_iupac(gt.dat);
+    if (ifs.error() || (progress && progress->cancelled()))
+        return 1;
+
+    // haploid calls of bases and at least one ambiguity code are diploid IUPAC genotypes
+    bool is_iupac = ploidy == 1 && (seen & GENO_AMBIGUOUS) && ! (seen & GENO_OTHER);
+    if ( is_iupac )
+        ploidy = 2;
+
+    if ( summary )
+        summary->begin(gt.ind);
+
+    // loci failing the summary filter are dropped, k loci are kept
+    auto m = gt.dat.size();
+    size_t k = 0;
 
-    for (auto &v : gt.dat) {
-        if ( iupac ) {
-            std::vector<allele_t> w;
-            w.reserve(v.size() * 2);
-            for (auto a : v) {
-                auto p = decode_iupac( static_cast<char>(a) );
-                w.push_back( static_cast<allele_t>( p.first ) );
-                w.push_back( static_cast<allele_t>( p.second ) );
+    size_t hist[256];
+    allele_t code[256];
+
+    for (size_t j = 0; j < m; ++j) {
+        auto &v = gt.dat[j];
+
+        // alleles in character order from a histogram of the calls, IUPAC codes count
+        // for both of their bases
+        std::fill(hist, hist + 256, 0);
+        for (auto a : v)
+            ++hist[a];
+
+        bool het = false;
+        if ( is_iupac ) {
+            for (int c = 1; c < 256; ++c) {
+                if (hist[c] > 0 && iupac.cls[c] == GENO_AMBIGUOUS) {
+                    het = true;
+                    hist[static_cast<unsigned char>(iupac.pair[c][0])] += hist[c];
+                    hist[static_cast<unsigned char>(iupac.pair[c][1])] += hist[c];
+                    hist[c] = 0;
+                }
+            }
+        }
+        else {
+            for (size_t i = 0; i < v.size() && ! het; i += ploidy) {
+                for (size_t t = 1; t < ploidy; ++t)
+                    het = het || v[i+t] != v[i];
+            }
+        }
+
+        std::vector<std::string> allele;
+        code[0] = 0;
+        for (int c = 1; c < 256; ++c) {
+            if (hist[c] > 0) {
+                allele.emplace_back(1, static_cast<char>(c));
+                code[c] = static_cast<allele_t>(allele.size());
+            }
+        }
+
+        // codes map one to one to alleles, IUPAC codes are decoded on the way
+        if ( is_iupac ) {
+            std::vector<allele_t> w(v.size() * 2);
+            for (size_t i = 0; i < v.size(); ++i) {
+                auto &p = iupac.pair[v[i]];
+                w[i*2] = code[static_cast<unsigned char>(p[0])];
+                w[i*2+1] = code[static_cast<unsigned char>(p[1])];
             }
             v.swap(w);
         }
+        else {
+            for (auto &a : v)
+                a = code[a];
+        }
 
-        auto u = v;
-        std::sort(u.begin(), u.end());
-        u.erase(std::unique(u.begin(), std::remove(u.begin(), u.end(), allele_t(0))), u.end());
+        if (summary && ! summary->add(gt.loc[j], gt.chr[j], gt.pos[j], allele, v))
+            continue;
+
+        if (k != j) {
+            gt.loc[k].swap(gt.loc[j]);
+            gt.chr[k].swap(gt.chr[j]);
+            gt.pos[k] = gt.pos[j];
+            gt.dat[k].swap(v);
+        }
+        ++k;
 
-        std::vector<std::string> allele;
-        for (auto a : u)
-            allele.emplace_back(1, a);
         gt.allele.push_back(allele);
+        gt.flag.push_back(allele_flags(allele) | (het ? LOCUS_HET : 0));
 
-        for (auto &a : v)
-            a = a == 0 ? 0 : static_cast<allele_t>( index(u,a) + 1 );
+        if (make_sparse(gt.dat[k-1], allele.size()))
+            gt.flag.back() |= LOCUS_SPARSE;
     }
 
-    gt.ploidy = iupac ? 2 : static_cast<int>(ploidy);
+    gt.loc.resize(k);
+    gt.chr.resize(k);
+    gt.pos.resize(k);
+    gt.dat.resize(k);
+
+    gt.ploidy = static_cast<int>(ploidy);
 
     return 0;
 }
 
-int read_genotype_string(const std::string &filename, Genotype &gt)
+int read_genotype_string(const std::string &filename, Genotype &gt, Progress *progress, GenotypeSummary *summary)
 {
-    std::ifstream ifs(filename);
+    LineReader ifs(filename, progress);
     if ( ! ifs ) {
-        std::cerr << "ERROR: can't open file for reading: " << filename << "\n";
+        log_stream() << "ERROR: can't open file for reading: " << filename << "\n";
         return 1;
     }
 
-    for (std::string line; std::getline(ifs, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
-
+    for (std::string line; ifs.getline(line); ) {
         std::vector<std::string> vs;
         split(line, " \t", vs);
         if ( vs.empty() )
             continue;
 
         if (vs.size() < 3) {
-            std::cerr << "ERROR: expected at least 3 columns at the first line\n";
+            log_stream() << "ERROR: expected at least 3 columns at the first line\n";
             return 1;
         }
 
@@ -280,10 +438,14 @@ int read_genotype_string(const std::string &filename, Genotype &gt)
     auto n = gt.ind.size();
     const Token missing("?", 1);
 
-    for (std::string line; std::getline(ifs, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
+    AlleleDict dict;
+    std::vector<std::uint32_t> codes, rank;
+    std::vector<size_t> order;
 
+    if ( summary )
+        summary->begin(gt.ind);
+
+    for (std::string line; ifs.getline(line); ) {
         std::vector<Token> vt;
         split(line, " \t/:", vt);
         if ( vt.empty() )
@@ -291,48 +453,81 @@ int read_genotype_string(const std::string &filename, Genotype &gt)
 
         if (ploidy == 0) {
             ploidy = vt.size() > (3 + n) ? (vt.size() - 3) / n : 1;
-            if (ploidy > 2) {
-                std::cerr << "ERROR: polyploidy (" << ploidy <<") genotype is not supported: "
-                          << vt[0].to_string() << "\n";
-                return 1;
-            }
         }
 
         if (vt.size() != 3 + ploidy * n) {
-            std::cerr << "ERROR: column count doesn't match at line (" << vt.size() << " != "
+            log_stream() << "ERROR: column count doesn't match at line " << ifs.line_number() << " (" << vt.size() << " != "
                       << 3 + ploidy * n << "): " << vt[0].to_string() << "\n";
             return 1;
         }
 
-        gt.loc.push_back(vt[0].to_string());
-        gt.chr.push_back(vt[1].to_string());
-        gt.pos.push_back(std::stoi(vt[2].to_string()));
+        pos_t pos = 0;
+        if ( ! parse_integer(vt[2], pos) ) {
+            log_stream() << "ERROR: invalid position at line " << ifs.line_number() << ": " << vt[2].to_string() << "\n";
+            return 1;
+        }
+
+        // codes in order of occurrence, missing is code 0; alleles are then numbered in
+        // sorted order
+        dict.clear();
+        dict.insert(missing);
+
+        codes.resize(vt.size() - 3);
+        bool het = false;
+        for (size_t i = 0; i < codes.size(); ++i) {
+            codes[i] = dict.insert(vt[i+3]);
+            size_t k = i % ploidy;
+            het = het || (k != 0 && codes[i] != codes[i-k]);
+        }
 
-        std::vector<Token> u(vt.begin() + 3, vt.end());
-        std::sort(u.begin(), u.end());
-        u.erase(std::unique(u.begin(), std::remove(u.begin(), u.end(), missing)), u.end());
+        auto &u = dict.keys();
+        auto na = u.size() - 1;
 
-        if (u.size() > std::numeric_limits<allele_t>::max()) {
-            std::cerr << "ERROR: exceed the maximum number of alleles: " << u.size() << "\n";
+        if (na > static_cast<size_t>(max_alleles)) {
+            log_stream() << "ERROR: exceed the maximum number of alleles (" << max_alleles << ") at line "
+                      << ifs.line_number() << ": " << na << "\n";
             return 1;
         }
 
+        order.resize(na);
+        for (size_t k = 0; k < na; ++k)
+            order[k] = k + 1;
+        std::sort(order.begin(), order.end(), [&u](size_t a, size_t b) { return u[a] < u[b]; });
+
         std::vector<std::string> allele;
-        for (auto &e : u)
-            allele.push_back(e.to_string());
-        gt.allele.push_back(allele);
+        rank.assign(na + 1, 0);
+        for (size_t k = 0; k < na; ++k) {
+            allele.push_back(u[order[k]].to_string());
+            rank[order[k]] = static_cast<std::uint32_t>(k + 1);
+        }
+
+        auto w = allele_width(na);
 
         std::vector<allele_t> v;
-        for (auto itr = vt.begin() + 3; itr != vt.end(); ++itr) {
-            if (*itr == missing)
-                v.push_back(0);
-            else
-                v.push_back( static_cast<allele_t>( index(u,*itr) + 1 ) );
-        }
+        v.reserve(codes.size() * w);
+        for (auto c : codes)
+            push_allele(v, rank[c], w);
 
-        gt.dat.push_back(v);
+        auto loc = vt[0].to_string(), chr = vt[1].to_string();
+
+        if (summary && ! summary->add(loc, chr, pos, allele, v))
+            continue;
+
+        gt.flag.push_back(allele_flags(allele) | (het ? LOCUS_HET : 0));
+
+        if (make_sparse(v, allele.size()))
+            gt.flag.back() |= LOCUS_SPARSE;
+
+        gt.loc.push_back(std::move(loc));
+        gt.chr.push_back(std::move(chr));
+        gt.pos.push_back(pos);
+        gt.allele.push_back(std::move(allele));
+        gt.dat.push_back(std::move(v));
     }
 
+    if (ifs.error() || (progress && progress->cancelled()))
+        return 1;
+
     gt.ploidy = static_cast<int>(ploidy);
 
     return 0;
@@ -341,9 +536,10 @@ int read_genotype_string(const std::string &filename, Genotype &gt)
 } // namespace
 
 
-int read_geno(const std::string &filename, Genotype &gt)
+int read_geno(const std::string &filename, Genotype &gt, Progress *progress, GenotypeSummary *summary)
 {
-    int info = read_genotype_char(filename, gt);
+    // the character reader gives up before any locus is counted
+    int info = read_genotype_char(filename, gt, progress, summary);
 
     if (info < 0) {
         gt.loc.clear();
@@ -351,65 +547,82 @@ int read_geno(const std::string &filename, Genotype &gt)
         gt.pos.clear();
         gt.dat.clear();
         gt.allele.clear();
-        info = read_genotype_string(filename, gt);
+        gt.flag.clear();
+        info = read_genotype_string(filename, gt, progress, summary);
     }
 
     return info;
 }
 
-int write_geno(const Genotype &gt, const std::string &filename)
+int write_geno(const Genotype &gt, const std::string &filename, Progress *progress, const std::vector<size_t> *loci)
 {
-    std::ofstream ofs(filename);
+    LineWriter ofs(filename);
     if ( ! ofs ) {
-        std::cerr << "ERROR: can't open file for writing: " << filename << "\n";
+        log_stream() << "ERROR: can't open file for writing: " << filename << "\n";
         return 1;
     }
 
-    auto m = gt.loc.size();
+    auto m = locus_count(gt, loci);
     auto n = gt.ind.size();
-    bool haploid = gt.ploidy != 2;
-    bool iupac = check_compat_iupac(gt) == 0;
-    bool homo = check_homozygous(gt) == 0;
+
+    // coding from the locus flags, the genotypes are not scanned
+    bool iupac = true, homozygous = true;
+    for (size_t k = 0; k < m; ++k) {
+        auto flag = locus_flags(gt, locus_index(loci, k));
+        iupac = iupac && (flag & LOCUS_ACGT);
+        homozygous = homozygous && ! (flag & LOCUS_HET);
+    }
+
     const std::string missing = iupac ? "N" : "?";
 
-    std::string line;
+    // coding is fixed per file, the genotype loops have no per-sample coding branches
+    size_t ploidy = std::max(gt.ploidy, 1);
+
+    auto coding = GENO_POLYPLOID;
+    if (ploidy == 1)
+        coding = GENO_HAPLOID;
+    else if (ploidy == 2 && iupac)
+        coding = GENO_IUPAC;
+    else if ( homozygous )
+        coding = GENO_HOMOZYGOUS;
+    else if (ploidy == 2)
+        coding = GENO_DIPLOID;
+
+    static void (* const coders[])(const std::vector<allele_t> &, const AlleleList &, size_t, size_t,
+                                    const std::string &, std::string &, std::vector<std::string> &, std::string &) = {
+        append_geno_locus<GENO_HAPLOID>, append_geno_locus<GENO_IUPAC>, append_geno_locus<GENO_HOMOZYGOUS>,
+        append_geno_locus<GENO_DIPLOID>, append_geno_locus<GENO_POLYPLOID>
+    };
+
+    auto coder = coders[coding];
+
+    std::string line, cc;
+    std::vector<std::string> sc;
+    std::vector<allele_t> buf;
 
     ofs << "Locus\tChromosome\tPosition";
     for (size_t i = 0; i < n; ++i)
         ofs << "\t" << gt.ind[i];
     ofs << "\n";
 
-    for (size_t j = 0; j < m; ++j) {
-        ofs << gt.loc[j] << "\t" << gt.chr[j] << "\t" << gt.pos[j];
+    for (size_t k = 0; k < m; ++k) {
+        if (progress && ! progress->add(0, 1))
+            return 1;
 
-        line.clear();
+        auto j = locus_index(loci, k);
 
-        for (size_t i = 0; i < n; ++i) {
-            line.push_back('\t');
-            if ( haploid ) {
-                auto a = gt.dat[j][i];
-                line.append(a == 0 ? missing : gt.allele[j][a-1]);
-            }
-            else {
-                auto a = gt.dat[j][i*2];
-                auto b = gt.dat[j][i*2+1];
-                if ( iupac ) {
-                    if (a == 0 || b == 0)
-                        line.append(missing);
-                    else
-                        line.push_back(encode_iupac(gt.allele[j][a-1][0], gt.allele[j][b-1][0]));
-                }
-                else {
-                    line.append(a == 0 ? missing : gt.allele[j][a-1]);
-                    if ( ! homo ) {
-                        line.push_back('/');
-                        line.append(b == 0 ? missing : gt.allele[j][b-1]);
-                    }
-                }
-            }
-        }
+        line.assign(gt.loc[j]).append("\t").append(gt.chr[j]).append("\t").append(std::to_string(gt.pos[j]));
 
-        ofs << line << "\n";
+        coder(locus_data(gt, j, buf), gt.allele[j], n, ploidy, missing, cc, sc, line);
+
+        line.push_back('\n');
+        ofs << line;
+    }
+
+    ofs.close();
+    if ( ! ofs ) {
+        log_stream() << "ERROR: failed to write file: " << filename << "\n";
+        return 1;
     }
 
     return 0;
@@ -23,9 +23,10 @@
 //   - missing genotype:  'N' or '-' or '.' or '?'
 //
 
-int read_geno(const std::string &filename, Genotype &gt);
+int read_geno(const std::string &filename, Genotype &gt, Progress *progress = nullptr, GenotypeSummary *summary = nullptr);
 
-int write_geno(const Genotype &gt, const std::string &filename);
+int write_geno(const Genotype &gt, const std::string &filename, Progress *progress = nullptr,
+               const std::vector<std::size_t> *loci = nullptr);
 
 
 #endif // GENO_H
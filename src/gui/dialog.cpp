@@ -1,9 +1,10 @@
-#include <QDir>
-#include <QDateTime>
+#include <QMap>
+#include <QCloseEvent>
 #include <QFileDialog>
 #include <QMessageBox>
 #include "dialog.h"
 #include "ui_dialog.h"
+#include "worker.h"
 
 #ifndef GCONV_VERSION
 #define GCONV_VERSION  "v1.1.dev"
@@ -12,14 +13,14 @@
 Dialog::Dialog(QWidget *parent) :
     QDialog(parent),
     ui(new Ui::Dialog),
-    proc_(0)
+    worker_(0)
 {
     ui->setupUi(this);
 
-    proc_ = new QProcess(this);
-    proc_->setProcessChannelMode(QProcess::MergedChannels);
-    connect(proc_, SIGNAL(readyReadStandardOutput()), this, SLOT(slot_proc_readyReadStandardOutput()));
-    connect(proc_, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(slot_proc_finished(int,QProcess::ExitStatus)));
+    worker_ = new Worker(this);
+    connect(worker_, SIGNAL(logged(QString)), this, SLOT(slot_worker_logged(QString)));
+    connect(worker_, SIGNAL(progressed(QString)), this, SLOT(slot_worker_progressed(QString)));
+    connect(worker_, SIGNAL(finished()), this, SLOT(slot_worker_finished()));
 
     setWindowTitle(QLatin1String("GCONV " GCONV_VERSION));
 }
@@ -31,11 +32,13 @@ Dialog::~Dialog()
 
 void Dialog::closeEvent(QCloseEvent *e)
 {
-    if ( isProcessRunning() ) {
+    if ( isWorkerRunning() ) {
         e->ignore();
         return;
     }
 
+    worker_->wait();
+
     e->accept();
 }
 
@@ -55,41 +58,31 @@ void Dialog::on_pushButtonOut_clicked()
 
 void Dialog::on_buttonBox_accepted()
 {
-    QString prog = QDir(QApplication::applicationDirPath()).filePath(QLatin1String("gconv"));
-#ifdef Q_OS_DARWIN
-    if (prog.endsWith(QLatin1String(".app/Contents/MacOS"))) {
-        QDir dir(prog);
-        dir.cdUp();
-        dir.cdUp();
-        dir.cdUp();
-        prog = exe.absolutePath();
-    }
-#endif
+    if ( worker_->isRunning() )
+        return;
 
-    QStringList format, suffix;
+    static const Format format[] = { Format::vcf, Format::ped, Format::hmp, Format::geno };
 
-    format << QLatin1String("--vcf")
-           << QLatin1String("--ped")
-           << QLatin1String("--hmp")
-           << QLatin1String("--geno");
+    QStringList suffix;
 
     suffix << QLatin1String(".vcf")
            << QLatin1String(".ped")
            << QLatin1String(".hmp")
            << QLatin1String(".geno");
 
-    QStringList args;
-
-    if ( ! ui->lineEditIn->text().isEmpty() )
-        args << format.at(ui->comboBoxIn->currentIndex()) << ui->lineEditIn->text();
-
-    if ( ! ui->lineEditOut->text().isEmpty() )
-        args << QLatin1String("--out") << ui->lineEditOut->text() + suffix.at(ui->comboBoxOut->currentIndex());
+    if ( ui->lineEditIn->text().isEmpty() || ui->lineEditOut->text().isEmpty() ) {
+        QMessageBox::critical(this, tr("ERROR"), tr("Input and output files are required."));
+        return;
+    }
 
-    if ( ui->checkBoxSort->isChecked() )
-        args << QLatin1String("--sort");
+    worker_->setJob(format[ui->comboBoxIn->currentIndex()], ui->lineEditIn->text(),
+                    ui->lineEditOut->text() + suffix.at(ui->comboBoxOut->currentIndex()),
+                    ui->checkBoxSort->isChecked());
+    worker_->start();
 
-    startProcess(prog, args);
+    ui->progressBar->setRange(0,0);
+    ui->progressBar->reset();
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setDisabled(true);
 }
 
 void Dialog::on_buttonBox_rejected()
@@ -97,60 +90,82 @@ void Dialog::on_buttonBox_rejected()
     if (ui->buttonBox->button(QDialogButtonBox::Ok)->isEnabled())
         close();
 
-    isProcessRunning();
+    isWorkerRunning();
 }
 
-void Dialog::slot_proc_readyReadStandardOutput()
+void Dialog::slot_worker_logged(const QString &text)
 {
-    QByteArray v = proc_->readAllStandardOutput();
     ui->plainTextEditLog->moveCursor(QTextCursor::End);
-    ui->plainTextEditLog->insertPlainText(QString::fromLocal8Bit(v.data(),v.size()));
+    ui->plainTextEditLog->insertPlainText(text);
     ui->plainTextEditLog->moveCursor(QTextCursor::End);
 }
 
-void Dialog::slot_proc_finished(int code, QProcess::ExitStatus status)
+void Dialog::slot_worker_finished()
 {
-    ui->progressBar->setRange(0,1);
-    ui->progressBar->reset();
-    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
+    resetProgress();
+
+    if ( worker_->isCancelled() ) {
+        slot_worker_logged(tr("INFO: conversion cancelled\n"));
+        return;
+    }
 
-    if (status != QProcess::NormalExit || code != 0) {
-        QMessageBox::critical(this, tr("ERROR"), tr("Process exited unexpectedly: code %1, status %2.").arg(code).arg(status));
+    if (worker_->status() != 0) {
+        QMessageBox::critical(this, tr("ERROR"), tr("Conversion failed, see log for details."));
         return;
     }
 }
 
-bool Dialog::isProcessRunning()
+// PROGRESS<TAB>stage=read<TAB>bytes=...<TAB>percent=12.5<TAB>eta_s=30.0 ...
+void Dialog::slot_worker_progressed(const QString &line)
 {
-    if (proc_->state() != QProcess::NotRunning) {
-        if (QMessageBox::question(this, tr("Terminate"), tr("Stop currently running computations?"), QMessageBox::Ok | QMessageBox::Cancel) != QMessageBox::Ok)
-            return true;
+    QMap<QString, QString> kv;
+    foreach (const QString &e, line.split(QLatin1Char('\t'))) {
+        int k = e.indexOf(QLatin1Char('='));
+        if (k > 0)
+            kv[e.left(k)] = e.mid(k + 1);
+    }
 
-        disconnect(proc_, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(slot_proc_finished(int,QProcess::ExitStatus)));
-        proc_->close();
+    double percent = kv.value(QLatin1String("percent")).toDouble();
+    double rps = kv.value(QLatin1String("records_per_s")).toDouble();
+    double mbs = kv.value(QLatin1String("mb_per_s")).toDouble();
+    double eta = kv.value(QLatin1String("eta_s")).toDouble();
 
-        ui->progressBar->setRange(0,1);
-        ui->progressBar->reset();
-        ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
+    QString text = kv.value(QLatin1String("stage"));
+    if (mbs > 0)
+        text += tr(" %1 MB/s").arg(mbs, 0, 'f', 1);
+    text += tr(" %1 records/s").arg(rps, 0, 'f', 0);
 
-        connect(proc_, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(slot_proc_finished(int,QProcess::ExitStatus)));
+    if (percent < 0) {
+        ui->progressBar->setRange(0,0);
+    }
+    else {
+        ui->progressBar->setRange(0,1000);
+        ui->progressBar->setValue(static_cast<int>(percent * 10));
+        text += QLatin1String(" %p%");
+        if (eta >= 0)
+            text += tr(" ETA %1 s").arg(eta, 0, 'f', 0);
     }
 
-    return false;
+    ui->progressBar->setFormat(text);
 }
 
-void Dialog::startProcess(const QString &prog, const QStringList &args)
+bool Dialog::isWorkerRunning()
 {
-    if ( isProcessRunning() )
-        return;
+    if ( worker_->isRunning() ) {
+        if (QMessageBox::question(this, tr("Terminate"), tr("Stop currently running computations?"), QMessageBox::Ok | QMessageBox::Cancel) != QMessageBox::Ok)
+            return true;
 
-    proc_->start(prog, args);
-    if ( ! proc_->waitForStarted() ) {
-        QMessageBox::critical(this, tr("ERROR"), tr("Can't start process: %1").arg(prog));
-        return;
+        // cooperative, the worker stops at the next line and emits finished()
+        worker_->cancel();
     }
 
-    ui->progressBar->setRange(0,0);
+    return false;
+}
+
+void Dialog::resetProgress()
+{
+    ui->progressBar->setRange(0,1);
     ui->progressBar->reset();
-    ui->buttonBox->button(QDialogButtonBox::Ok)->setDisabled(true);
+    ui->progressBar->setFormat(QLatin1String("%p%"));
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
 }
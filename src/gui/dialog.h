@@ -2,12 +2,13 @@
 #define DIALOG_H
 
 #include <QDialog>
-#include <QProcess>
 
 namespace Ui {
 class Dialog;
 }
 
+class Worker;
+
 class Dialog : public QDialog
 {
     Q_OBJECT
@@ -32,20 +33,22 @@ private slots:
 
     void on_buttonBox_rejected();
 
-    void slot_proc_readyReadStandardOutput();
+    void slot_worker_logged(const QString &text);
+
+    void slot_worker_progressed(const QString &line);
 
-    void slot_proc_finished(int code, QProcess::ExitStatus status);
+    void slot_worker_finished();
 
 private:
 
-    bool isProcessRunning();
+    bool isWorkerRunning();
 
-    void startProcess(const QString &prog, const QStringList &args);
+    void resetProgress();
 
 private:
 
     Ui::Dialog *ui;
-    QProcess *proc_;
+    Worker *worker_;
 };
 
 #endif // DIALOG_H
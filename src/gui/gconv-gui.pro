@@ -5,12 +5,33 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = gconv-gui
 TEMPLATE = app
 
+CONFIG += c++11
+lessThan(QT_MAJOR_VERSION, 5): QMAKE_CXXFLAGS += -std=c++11
+
 DEFINES += QT_NO_CAST_FROM_ASCII QT_NO_CAST_TO_ASCII
 DEFINES += QT_DEPRECATED_WARNINGS
 
+win32: LIBS += -lpsapi
+
 SOURCES += main.cpp \
-        dialog.cpp
+        dialog.cpp \
+        worker.cpp \
+        ../convert.cpp \
+        ../geno.cpp \
+        ../hmp.cpp \
+        ../kernel.cpp \
+        ../lineio.cpp \
+        ../log.cpp \
+        ../mapfile.cpp \
+        ../ped.cpp \
+        ../perf.cpp \
+        ../progress.cpp \
+        ../stream.cpp \
+        ../summary.cpp \
+        ../util.cpp \
+        ../vcf.cpp
 
-HEADERS += dialog.h
+HEADERS += dialog.h \
+        worker.h
 
 FORMS += dialog.ui
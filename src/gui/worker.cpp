@@ -0,0 +1,108 @@
+#include <QFile>
+#include "worker.h"
+#include "../log.h"
+
+namespace {
+
+std::string local_path(const QString &s)
+{
+    return std::string(QFile::encodeName(s).constData());
+}
+
+} // namespace
+
+Worker::Worker(QObject *parent) :
+    QThread(parent),
+    sorted_(false),
+    format_(Format::unknown),
+    sort_(false),
+    status_(0)
+{
+}
+
+Worker::~Worker()
+{
+    cancel();
+    wait();
+}
+
+void Worker::setJob(Format format, const QString &in, const QString &out, bool sort)
+{
+    format_ = format;
+    in_ = in;
+    out_ = out;
+    sort_ = sort;
+    status_ = 0;
+
+    progress_.reset(new Progress([this](const Progress &p) {
+        emit progressed(QString::fromStdString(p.format()));
+    }));
+}
+
+void Worker::cancel()
+{
+    if ( progress_ )
+        progress_->cancel();
+}
+
+bool Worker::isCancelled() const
+{
+    return progress_ && progress_->cancelled();
+}
+
+void Worker::run()
+{
+    // engine messages of this conversion only, delivered to the GUI thread by a queued connection
+    LogScope scope([this](const std::string &line) {
+        QMetaObject::invokeMethod(this, "logged", Qt::QueuedConnection,
+                                  Q_ARG(QString, QString::fromLocal8Bit(line.data(), static_cast<int>(line.size()))));
+    });
+
+    try {
+        status_ = convert();
+    }
+    catch (const std::exception &e) {
+        log_stream() << "ERROR: exception caught: " << e.what() << "\n";
+        status_ = 1;
+    }
+}
+
+int Worker::convert()
+{
+    Progress *progress = progress_.data();
+
+    // the genotype is loaded again for another input, or when unsorted loci are requested after sorting
+    QString key = QString::number(static_cast<int>(format_)) + QLatin1Char('\t') + in_;
+
+    if (key != loaded_ || (sorted_ && ! sort_)) {
+        loaded_.clear();
+        sorted_ = false;
+        gt_ = Genotype();
+
+        log_stream() << "INFO: reading genotype file...\n";
+
+        std::vector<std::string> filenames(1, local_path(in_));
+        if (load_genotype(format_, filenames, gt_, progress) != 0) {
+            gt_ = Genotype();
+            return 1;
+        }
+
+        log_stream() << "INFO: " << gt_.ind.size() << " individuals, " << gt_.loc.size() << " loci\n";
+
+        loaded_ = key;
+    }
+    else
+        log_stream() << "INFO: reusing loaded genotype: " << local_path(in_) << "\n";
+
+    if (sort_ && ! sorted_) {
+        sort_chrpos(gt_, progress);
+        sorted_ = true;
+    }
+
+    if (save_genotype(gt_, local_path(out_), progress) != 0)
+        return 1;
+
+    log_stream() << "INFO: genotype file written: " << local_path(out_) << "\n";
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <QThread>
+#include <QScopedPointer>
+#include <QStringList>
+#include "../convert.h"
+#include "../progress.h"
+
+// Runs conversions on a background thread with the in-process engine
+//
+//   The loaded genotype is kept between runs, so exporting the same input to
+//   several formats parses the input only once.
+
+class Worker : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    explicit Worker(QObject *parent = 0);
+
+    ~Worker();
+
+    // must not be called while running
+    void setJob(Format format, const QString &in, const QString &out, bool sort);
+
+    void cancel();
+
+    bool isCancelled() const;
+
+    int status() const { return status_; }
+
+signals:
+
+    void progressed(const QString &line);
+
+    void logged(const QString &text);
+
+protected:
+
+    void run();
+
+private:
+
+    int convert();
+
+private:
+
+    Genotype gt_;
+    QString loaded_;
+    bool sorted_;
+
+    Format format_;
+    QString in_;
+    QString out_;
+    bool sort_;
+
+    int status_;
+    QScopedPointer<Progress> progress_;
+};
+
+#endif // WORKER_H
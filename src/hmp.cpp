@@ -1,8 +1,12 @@
-#include <fstream>
 #include <iostream>
 #include <algorithm>
 #include "hmp.h"
 #include "split.h"
+#include "number.h"
+#include "stream.h"
+#include "log.h"
+#include "progress.h"
+#include "summary.h"
 
 
 using std::size_t;
@@ -10,56 +14,112 @@ using std::size_t;
 
 namespace {
 
-int parse_hmp_gt(const char *s, size_t n, char &a, char &b)
+// call characters in ascending order, so alleles found by the histogram come out sorted,
+// N (missing) is last
+const char hmp_chars[] = "ACDGITN";
+const size_t hmp_nsym = 7;
+const allele_t hmp_missing = 6;
+const allele_t hmp_bad = 0xFF;
+
+// symbol of each byte, hmp_bad if it is not a call character
+struct HmpSymbols
 {
-    if (n != 2) {
-        std::cerr << "ERROR: HapMap genotype must be represented by 2 characters: " << std::string(s, n) << "\n";
-        return 1;
+    allele_t sym[256];
+
+    HmpSymbols()
+    {
+        std::fill(sym, sym + 256, hmp_bad);
+        for (size_t k = 0; k < hmp_nsym; ++k)
+            sym[static_cast<unsigned char>(hmp_chars[k])] = static_cast<allele_t>(k);
     }
+};
 
-    a = s[0];
-    b = s[1];
+const HmpSymbols hmp_symbols;
 
-    if ((a != 'A' && a != 'C' && a != 'G' && a != 'T' && a != 'I' && a != 'D' && a != 'N') ||
-        (b != 'A' && b != 'C' && b != 'G' && b != 'T' && b != 'I' && b != 'D' && b != 'N')) {
-        std::cerr << "ERROR: invalid HapMap genotype code: " << std::string(s, n) << "\n";
-        return 2;
+// symbols of the calls of a row, each call counted in hist
+int parse_hmp_gts(std::vector<Token>::const_iterator first, std::vector<Token>::const_iterator last,
+                  allele_t *gt, size_t *hist, bool &het)
+{
+    auto sym = hmp_symbols.sym;
+
+    for (auto itr = first; itr != last; ++itr, gt += 2) {
+        auto s = itr->data();
+        if (itr->size() != 2) {
+            log_stream() << "ERROR: HapMap genotype must be represented by 2 characters: " << itr->to_string() << "\n";
+            return 1;
+        }
+
+        auto a = sym[static_cast<unsigned char>(s[0])];
+        auto b = sym[static_cast<unsigned char>(s[1])];
+        if (a == hmp_bad || b == hmp_bad) {
+            log_stream() << "ERROR: invalid HapMap genotype code: " << itr->to_string() << "\n";
+            return 2;
+        }
+
+        gt[0] = a;
+        gt[1] = b;
+        ++hist[a];
+        ++hist[b];
+        het = het || a != b;
     }
 
     return 0;
 }
 
-int check_compat_hmp(const Genotype &gt)
+// single character allele codes, pairs[2*(a*stride+b)] is the genotype a/b
+template<bool Haploid>
+void append_hmp_chars(const allele_t *dat, size_t n, const char *pairs, size_t stride, std::string &line)
 {
-    for (auto &v : gt.allele) {
-        if (v.size() > 2)
-            return 1;
+    auto k = line.size();
+    line.resize(k + 3 * n);
+    auto p = &line[k];
+
+    for (size_t i = 0; i < n; ++i, p += 3) {
+        auto a = Haploid ? dat[i] : dat[i*2];
+        auto b = Haploid ? dat[i] : dat[i*2+1];
+        auto c = pairs + 2 * (a * stride + b);
+        p[0] = ' ';
+        p[1] = c[0];
+        p[2] = c[1];
+    }
+}
 
-        for (auto &e : v) {
-            if (e.size() == 1) {
-                if (e != "A" && e != "C" && e != "G" && e != "T" && e != "-")
-                    return 2;
-            }
-            else {
-                if (e.find_first_not_of("ACGT") != std::string::npos)
-                    return 3;
-            }
+template<bool Haploid>
+void append_hmp_strings(const allele_t *dat, size_t n, const AlleleList &as, std::string &line)
+{
+    for (size_t i = 0; i < n; ++i) {
+        auto a = Haploid ? dat[i] : dat[i*2];
+        auto b = Haploid ? dat[i] : dat[i*2+1];
+        if (a && b) {
+            line.push_back(' ');
+            line.append(as[a-1]).append(as[b-1]);
         }
+        else
+            line.append(" NN");
     }
-
-    return 0;
 }
 
 } // namespace
 
 
+int check_compat_hmp(std::uint8_t flag)
+{
+    if ( ! (flag & LOCUS_BIALLELIC) )
+        return 1;
+
+    if ( ! (flag & LOCUS_SEQUENCE) )
+        return 2;
+
+    return 0;
+}
+
 int parse_hmp_header(const std::string &s, std::vector<std::string> &v)
 {
     v.clear();
     split(s, " \t", v);
 
     if (v.size() < 11) {
-        std::cerr << "ERROR: incorrect number of columns in HapMap header line: " << v.size() << "\n";
+        log_stream() << "ERROR: incorrect number of columns in HapMap header line: " << v.size() << "\n";
         return 1;
     }
 
@@ -74,46 +134,54 @@ int parse_hmp_entry(const std::string &s, HmpEntry &e)
     split(s, " \t", v);
 
     if (v.size() < 11) {
-        std::cerr << "ERROR: incorrect number of columns at HapMap entry line: " << v.size() << "\n";
+        log_stream() << "ERROR: incorrect number of columns at HapMap entry line: " << v.size() << "\n";
         return 1;
     }
 
     e.id = v[0].to_string();
     e.chr = v[2].to_string();
-    e.pos = std::stoi(v[3].to_string());
 
-    e.gt.clear();
-    for (auto itr = v.begin() + 11; itr != v.end(); ++itr) {
-        char a, b;
-        if (parse_hmp_gt(itr->data(), itr->size(), a, b) != 0)
-            return 1;
-        e.gt.push_back( static_cast<allele_t>(a) );
-        e.gt.push_back( static_cast<allele_t>(b) );
+    if ( ! parse_integer(v[3], e.pos) ) {
+        log_stream() << "ERROR: invalid position: " << v[3].to_string() << "\n";
+        return 1;
     }
 
+    // calls are parsed to symbols, then mapped to allele codes
+    bool het = false;
+    size_t hist[hmp_nsym] = { 0 };
+
+    e.gt.resize(2 * (v.size() - 11));
+    if (parse_hmp_gts(v.begin() + 11, v.end(), e.gt.data(), hist, het) != 0)
+        return 1;
+
     e.as.clear();
     split(v[1].to_string(), "/", e.as);
 
     if (e.as.size() != 2 || e.as[0] == "N" || e.as[1] == "N") {
-        auto z = e.gt;
-        std::sort(z.begin(), z.end());
-        z.erase(std::unique(z.begin(), std::remove(z.begin(), z.end(), 'N')), z.end());
+        std::string z;
+        for (size_t k = 0; k < hmp_nsym; ++k) {
+            if (k != hmp_missing && hist[k] > 0)
+                z.push_back(hmp_chars[k]);
+        }
 
         if (z.size() > 2) {
-            std::cerr << "ERROR: HapMap variant must be bi-allelic: " << z[0];
+            log_stream() << "ERROR: HapMap variant must be bi-allelic: " << z[0];
             for (size_t i = 1; i < z.size(); ++i)
-                std::cerr << "/" << z[i];
-            std::cerr << "\n";
+                log_stream() << "/" << z[i];
+            log_stream() << "\n";
             return 1;
         }
 
         e.as.clear();
-        if ( ! z.empty() )
-            e.as.emplace_back(1, z[0]);
-        if (z.size() == 2)
-            e.as.emplace_back(1, z[1]);
+        for (auto c : z)
+            e.as.emplace_back(1, c);
     }
 
+    // codes map one to one to alleles and N to missing, a single allele fills all genotypes
+    e.flag = allele_flags(e.as);
+    if (het && e.as.size() > 1)
+        e.flag |= LOCUS_HET;
+
     if ( e.as.empty() ) {
         std::fill(e.gt.begin(), e.gt.end(), 0);
         return 0;
@@ -124,156 +192,201 @@ int parse_hmp_entry(const std::string &s, HmpEntry &e)
         return 0;
     }
 
-    allele_t ref = 'N', alt = 'N';
+    char ref = 'N', alt = 'N';
     if (e.as[0] == "A" || e.as[0] == "C" || e.as[0] == "G" || e.as[0] == "T")
-        ref = static_cast<allele_t>( e.as[0][0] );
+        ref = e.as[0][0];
     if (e.as[1] == "A" || e.as[1] == "C" || e.as[1] == "G" || e.as[1] == "T")
-        alt = static_cast<allele_t>( e.as[1][0] );
-
-    static const allele_t mis = 'N', ins = 'I', del = 'D';
-
-    for (auto &a : e.gt) {
-        if (a == mis)
-            a = 0;
-        else if (a == ref)
-            a = 1;
-        else if (a == alt)
-            a = 2;
-        else if (a == ins)
-            a = e.as[0] == "-" ? 2 : 1;
-        else if (a == del)
-            a = e.as[0] == "-" ? 1 : 2;
-        else {
-            std::cerr << "ERROR: inconsistent allele code: " << e.id << ", " << v[1].to_string() << ", " << a << "\n";
+        alt = e.as[1][0];
+
+    bool deletion = e.as[0] == "-";
+
+    // allele code of each symbol, checked for the symbols that occur
+    allele_t code[hmp_nsym];
+    for (size_t k = 0; k < hmp_nsym; ++k) {
+        auto c = hmp_chars[k];
+        if (k == hmp_missing)
+            code[k] = 0;
+        else if (c == ref)
+            code[k] = 1;
+        else if (c == alt)
+            code[k] = 2;
+        else if (c == 'I')
+            code[k] = deletion ? 2 : 1;
+        else if (c == 'D')
+            code[k] = deletion ? 1 : 2;
+        else
+            code[k] = hmp_bad;
+
+        if (code[k] == hmp_bad && hist[k] > 0) {
+            log_stream() << "ERROR: inconsistent allele code: " << e.id << ", " << v[1].to_string() << ", " << c << "\n";
             return 1;
         }
     }
 
+    for (auto &a : e.gt)
+        a = code[a];
+
     return 0;
 }
 
-int read_hmp(const std::string &filename, Genotype &gt)
+int read_hmp(const std::string &filename, Genotype &gt, Progress *progress, GenotypeSummary *summary)
 {
-    std::ifstream ifs(filename);
-    if ( ! ifs ) {
-        std::cerr << "ERROR: can't open file for reading: " << filename << "\n";
+    HmpSource src(filename, progress);
+    if ( src.error() )
         return 1;
+
+    gt.ind = src.samples();
+
+    if ( summary )
+        summary->begin(gt.ind);
+
+    for (Locus rec; src.next(rec); ) {
+        if (summary && ! summary->add(rec.loc, rec.chr, rec.pos, rec.allele, rec.dat))
+            continue;
+        append_locus(gt, rec);
     }
 
-    for (std::string line; std::getline(ifs, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
+    if ( src.error() )
+        return 1;
 
-        if (parse_hmp_header(line, gt.ind) != 0)
-            return 1;
+    gt.ploidy = 2;
 
-        break;
+    return 0;
+}
+
+std::string format_hmp_header(const std::vector<std::string> &ind)
+{
+    std::string s = "rs# alleles chrom pos strand assembly# center protLSID assayLSID panelLSID QCcode";
+
+    for (auto &e : ind)
+        s.append(" ").append(e);
+
+    s.push_back('\n');
+
+    return s;
+}
+
+int format_hmp_entry(const std::string &id, const std::string &chr, pos_t pos, const AlleleList &as,
+                     const std::vector<allele_t> &dat, size_t n, std::string &line)
+{
+    if (dat.size() > n * 2)
+        return 4;
+
+    line.append(id).append(" ");
+
+    if ( as.empty() )
+        line.append("N/N");
+    else {
+        line.append(as[0]);
+        if (as.size() == 1)
+            line.append("/N");
+        else
+            line.append("/").append(as[1]);
     }
 
-    HmpEntry e;
+    line.append(" ").append(chr).append(" ").append(std::to_string(pos)).append(" + NA NA NA NA NA NA");
 
-    for (std::string line; std::getline(ifs, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
+    bool indel = false;
+    if (as.size() == 1 && (as[0] == "-" || as[0].size() > 1))
+        indel = true;
+    if (as.size() == 2 && (as[0] == "-" || as[1] == "-"))
+        indel = true;
 
-        if (parse_hmp_entry(line, e) != 0)
-            return 1;
+    bool haploid = dat.size() != n * 2;
 
-        if (e.gt.size() != 2 * gt.ind.size()) {
-            std::cerr << "ERROR: column count doesn't match at " << e.id << "\n";
-            return 1;
+    // alleles coded by one character, indels as D/I
+    char codes[3] = { 'N', 0, 0 };
+    auto na = as.size();
+    bool single = true;
+
+    if ( indel ) {
+        codes[1] = as[0] == "-" ? 'D' : 'I';
+        codes[2] = as[0] == "-" ? 'I' : 'D';
+    }
+    else {
+        // na <= 2, checked by check_compat_hmp
+        for (size_t k = 0; k < na && k < 2; ++k) {
+            if (as[k].size() != 1)
+                single = false;
+            else
+                codes[k+1] = as[k][0];
         }
+    }
 
-        gt.loc.push_back(e.id);
-        gt.chr.push_back(e.chr);
-        gt.pos.push_back(e.pos);
-        gt.allele.push_back(e.as);
-        gt.dat.push_back(e.gt);
+    if ( ! single ) {
+        if ( haploid )
+            append_hmp_strings<true>(dat.data(), n, as, line);
+        else
+            append_hmp_strings<false>(dat.data(), n, as, line);
+        return 0;
     }
 
-    gt.ploidy = 2;
+    // missing if either allele is missing
+    char pairs[18];
+    for (size_t a = 0; a < 3; ++a) {
+        for (size_t b = 0; b < 3; ++b) {
+            pairs[2*(a*3+b)] = a && b ? codes[a] : 'N';
+            pairs[2*(a*3+b)+1] = a && b ? codes[b] : 'N';
+        }
+    }
+
+    if ( haploid )
+        append_hmp_chars<true>(dat.data(), n, pairs, 3, line);
+    else
+        append_hmp_chars<false>(dat.data(), n, pairs, 3, line);
 
     return 0;
 }
 
-int write_hmp(const Genotype &gt, const std::string &filename)
+int write_hmp(const Genotype &gt, const std::string &filename, Progress *progress, const std::vector<size_t> *loci)
 {
-    int info = check_compat_hmp(gt);
-    if (info != 0) {
-        std::cerr << "ERROR: genotype data is not compatible with HapMap format: " << info << "\n";
+    if (gt.ploidy > 2) {
+        log_stream() << "ERROR: HapMap format only supports haploid and diploid genotypes: " << gt.ploidy << "\n";
         return 1;
     }
 
-    std::ofstream ofs(filename);
-    if ( ! ofs ) {
-        std::cerr << "ERROR: can't open file for writing: " << filename << "\n";
-        return 1;
+    auto m = locus_count(gt, loci);
+    auto n = gt.ind.size();
+
+    // alleles only, recorded flags save the string scans
+    for (size_t k = 0; k < m; ++k) {
+        auto j = locus_index(loci, k);
+        int info = check_compat_hmp(j < gt.flag.size() ? gt.flag[j] : allele_flags(gt.allele[j]));
+        if (info != 0) {
+            log_stream() << "ERROR: genotype data is not compatible with HapMap format: " << info << "\n";
+            return 1;
+        }
     }
 
-    auto m = gt.loc.size();
-    auto n = gt.ind.size();
-    bool haploid = gt.ploidy != 2;
-
-    std::vector<char> indel(m, 0);
-    for (size_t j = 0; j < m; ++j) {
-        auto& as = gt.allele[j];
-        if (as.size() == 1 && (as[0] == "-" || as[0].size() > 1))
-            indel[j] = 1;
-        if (as.size() == 2 && (as[0] == "-" || as[1] == "-"))
-            indel[j] = 1;
+    LineWriter ofs(filename);
+    if ( ! ofs ) {
+        log_stream() << "ERROR: can't open file for writing: " << filename << "\n";
+        return 1;
     }
 
-    ofs << "rs# alleles chrom pos strand assembly# center protLSID assayLSID panelLSID QCcode";
-    for (size_t i = 0; i < n; ++i)
-        ofs << " " << gt.ind[i];
-    ofs << "\n";
+    ofs << format_hmp_header(gt.ind);
 
     std::string line;
+    std::vector<allele_t> buf;
 
-    for (size_t j = 0; j < m; ++j) {
-        line.clear();
+    for (size_t k = 0; k < m; ++k) {
+        if (progress && ! progress->add(0, 1))
+            return 1;
 
-        if ( indel[j] ) {
-            auto ref = "D", alt = "I";
-            if (gt.allele[j][0] != "-")
-                std::swap(ref, alt);
-            for (size_t i = 0; i < n; ++i) {
-                auto a = haploid ? gt.dat[j][i] : gt.dat[j][i*2];
-                auto b = haploid ? gt.dat[j][i] : gt.dat[j][i*2+1];
-                if (a && b) {
-                    line.push_back(' ');
-                    line.append(a == 1 ? ref : alt).append(b == 1 ? ref : alt);
-                }
-                else
-                    line.append(" NN");
-            }
-        }
-        else {
-            for (size_t i = 0; i < n; ++i) {
-                auto a = haploid ? gt.dat[j][i] : gt.dat[j][i*2];
-                auto b = haploid ? gt.dat[j][i] : gt.dat[j][i*2+1];
-                if (a && b) {
-                    line.push_back(' ');
-                    line.append(gt.allele[j][a-1]).append(gt.allele[j][b-1]);
-                }
-                else
-                    line.append(" NN");
-            }
-        }
+        auto j = locus_index(loci, k);
 
-        ofs << gt.loc[j] << " ";
+        line.clear();
+        // alleles are checked above, loci of 16-bit allele codes never pass
+        format_hmp_entry(gt.loc[j], gt.chr[j], gt.pos[j], gt.allele[j], locus_data(gt, j, buf), n, line);
+        line.push_back('\n');
 
-        if ( gt.allele[j].empty() )
-            ofs << "N/N";
-        else {
-            ofs << gt.allele[j][0];
-            if (gt.allele[j].size() == 1)
-                ofs << "/N";
-            else
-                ofs << "/" << gt.allele[j][1];
-        }
+        ofs << line;
+    }
 
-        ofs << " " << gt.chr[j] << " " << gt.pos[j] << " + NA NA NA NA NA NA" << line << "\n";
+    ofs.close();
+    if ( ! ofs ) {
+        log_stream() << "ERROR: failed to write file: " << filename << "\n";
+        return 1;
     }
 
     return 0;
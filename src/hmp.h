@@ -38,7 +38,8 @@ struct HmpEntry
     std::string id;
     std::vector<std::string> as;
     std::vector<allele_t> gt;
-    int pos = -1;
+    pos_t pos = -1;
+    std::uint8_t flag = 0;
 };
 
 
@@ -46,9 +47,20 @@ int parse_hmp_header(const std::string &s, std::vector<std::string> &v);
 
 int parse_hmp_entry(const std::string &s, HmpEntry &e);
 
-int read_hmp(const std::string &filename, Genotype &gt);
+int read_hmp(const std::string &filename, Genotype &gt, Progress *progress = nullptr, GenotypeSummary *summary = nullptr);
 
-int write_hmp(const Genotype &gt, const std::string &filename);
+std::string format_hmp_header(const std::vector<std::string> &ind);
+
+// non-zero if the alleles of a locus by its LocusFlag bits can't be coded in HapMap
+int check_compat_hmp(std::uint8_t flag);
+
+// append a HapMap data line without newline, the alleles must pass check_compat_hmp;
+// non-zero if the ploidy can't be coded in HapMap
+int format_hmp_entry(const std::string &id, const std::string &chr, pos_t pos, const AlleleList &as,
+                     const std::vector<allele_t> &dat, std::size_t n, std::string &line);
+
+int write_hmp(const Genotype &gt, const std::string &filename, Progress *progress = nullptr,
+              const std::vector<std::size_t> *loci = nullptr);
 
 
 #endif // HMP_H
@@ -0,0 +1,273 @@
+#include "kernel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+
+// GCONV_KERNEL_NS is set for the ISA specific builds, GCONV_KERNEL_V2/V3 tell the
+// baseline build which of them are linked
+
+#ifndef GCONV_KERNEL_NS
+#define GCONV_KERNEL_NS kernel_base
+#define GCONV_KERNEL_DISPATCH
+#endif
+
+#define GCONV_STR2(x) #x
+#define GCONV_STR(x) GCONV_STR2(x)
+
+
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+
+
+namespace GCONV_KERNEL_NS {
+
+namespace {
+
+void delim_mask(const char *s, size_t n, char a, char b, uint64_t *mask)
+{
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        uint64_t m = 0;
+#if defined(__AVX2__)
+        auto va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+        for (int k = 0; k < 64; k += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + k));
+            auto e = _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb));
+            m |= static_cast<uint64_t>(static_cast<unsigned>(_mm256_movemask_epi8(e))) << k;
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        auto va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+        for (int k = 0; k < 64; k += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + k));
+            auto e = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb));
+            m |= static_cast<uint64_t>(_mm_movemask_epi8(e)) << k;
+        }
+#else
+        for (int k = 0; k < 64; ++k)
+            m |= static_cast<uint64_t>(s[i+k] == a || s[i+k] == b) << k;
+#endif
+        mask[i/64] = m;
+    }
+
+    if (i < n) {
+        uint64_t m = 0;
+        for (size_t k = 0; i + k < n; ++k)
+            m |= static_cast<uint64_t>(s[i+k] == a || s[i+k] == b) << k;
+        mask[i/64] = m;
+    }
+}
+
+#if defined(__AVX2__)
+
+uint64_t sum_epu8(__m256i a)
+{
+    alignas(32) uint64_t t[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(t), _mm256_sad_epu8(a, _mm256_setzero_si256()));
+    return t[0] + t[1] + t[2] + t[3];
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+uint64_t sum_epu8(__m128i a)
+{
+    alignas(16) uint64_t t[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(t), _mm_sad_epu8(a, _mm_setzero_si128()));
+    return t[0] + t[1];
+}
+
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+uint64_t sum_epu16(__m128i a)
+{
+    auto z = _mm_setzero_si128();
+    alignas(16) uint32_t t[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(t), _mm_add_epi32(_mm_unpacklo_epi16(a, z), _mm_unpackhi_epi16(a, z)));
+    return static_cast<uint64_t>(t[0]) + t[1] + t[2] + t[3];
+}
+
+#endif
+
+// byte lane counters are added up before they can wrap, after 255 blocks
+void count_codes(const unsigned char *s, size_t n, uint64_t *count)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    while (i + 32 <= n) {
+        auto end = n - i > 255 * 32 ? i + 255 * 32 : n - (n - i) % 32;
+        auto c0 = _mm256_setzero_si256(), c1 = c0, c2 = c0, c3 = c0;
+        for (; i < end; i += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            c0 = _mm256_sub_epi8(c0, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0)));
+            c1 = _mm256_sub_epi8(c1, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(1)));
+            c2 = _mm256_sub_epi8(c2, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(2)));
+            c3 = _mm256_sub_epi8(c3, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(3)));
+        }
+        count[0] += sum_epu8(c0);
+        count[1] += sum_epu8(c1);
+        count[2] += sum_epu8(c2);
+        count[3] += sum_epu8(c3);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    while (i + 16 <= n) {
+        auto end = n - i > 255 * 16 ? i + 255 * 16 : n - (n - i) % 16;
+        auto c0 = _mm_setzero_si128(), c1 = c0, c2 = c0, c3 = c0;
+        for (; i < end; i += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            c0 = _mm_sub_epi8(c0, _mm_cmpeq_epi8(v, _mm_set1_epi8(0)));
+            c1 = _mm_sub_epi8(c1, _mm_cmpeq_epi8(v, _mm_set1_epi8(1)));
+            c2 = _mm_sub_epi8(c2, _mm_cmpeq_epi8(v, _mm_set1_epi8(2)));
+            c3 = _mm_sub_epi8(c3, _mm_cmpeq_epi8(v, _mm_set1_epi8(3)));
+        }
+        count[0] += sum_epu8(c0);
+        count[1] += sum_epu8(c1);
+        count[2] += sum_epu8(c2);
+        count[3] += sum_epu8(c3);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        if (s[i] < 4)
+            ++count[s[i]];
+    }
+}
+
+// a genotype is a 16-bit lane of its two alleles, 8 per block in all SIMD builds as the
+// per-sample counters are 32-bit lanes; genotype counters are added up before they can wrap
+void diploid_stats(const unsigned char *s, size_t n, uint64_t *missing, uint64_t *het, uint32_t *miss)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    auto zero = _mm_setzero_si128();
+    auto ones = _mm_set1_epi8(-1);
+    auto low = _mm_set1_epi16(0xff);
+
+    while (i + 8 <= n) {
+        auto end = n - i > 65535 * 8 ? i + 65535 * 8 : n - (n - i) % 8;
+        auto cm = zero, ch = zero;
+        for (; i < end; i += 8) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i*2));
+            auto called = _mm_cmpeq_epi16(_mm_cmpeq_epi8(v, zero), zero);
+            auto same = _mm_cmpeq_epi16(_mm_and_si128(v, low), _mm_srli_epi16(v, 8));
+            auto m = _mm_xor_si128(called, ones);
+            cm = _mm_sub_epi16(cm, m);
+            ch = _mm_sub_epi16(ch, _mm_andnot_si128(same, called));
+            if ( miss ) {
+                auto p = reinterpret_cast<__m128i*>(miss + i);
+                _mm_storeu_si128(p, _mm_sub_epi32(_mm_loadu_si128(p), _mm_unpacklo_epi16(m, m)));
+                _mm_storeu_si128(p + 1, _mm_sub_epi32(_mm_loadu_si128(p + 1), _mm_unpackhi_epi16(m, m)));
+            }
+        }
+        *missing += sum_epu16(cm);
+        *het += sum_epu16(ch);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        auto a = s[i*2], b = s[i*2+1];
+        if (a == 0 || b == 0) {
+            ++*missing;
+            if ( miss )
+                ++miss[i];
+        }
+        else if (a != b)
+            ++*het;
+    }
+}
+
+// a call and its space are a 16-bit lane, 16 calls per block in all SIMD builds; the
+// scalar rest is left to the caller
+size_t ped_calls(const char *s, size_t n, unsigned char *out)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    auto zero = _mm_setzero_si128();
+    auto low = _mm_set1_epi16(0xff);
+    auto high = _mm_set1_epi16(static_cast<short>(0xff00));
+    auto space = _mm_set1_epi16(0x2000);
+
+    for (; i + 16 <= n; i += 16) {
+        auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i*2));
+        auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i*2 + 16));
+        auto sep = _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(v0, high), space),
+                                 _mm_cmpeq_epi16(_mm_and_si128(v1, high), space));
+        if (_mm_movemask_epi8(sep) != 0xffff)
+            break;
+
+        auto c = _mm_packus_epi16(_mm_and_si128(v0, low), _mm_and_si128(v1, low));
+        auto pick = [c](char x, char y, char to) {
+            auto m = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(x)), _mm_cmpeq_epi8(c, _mm_set1_epi8(y)));
+            return _mm_and_si128(m, _mm_set1_epi8(to));
+        };
+
+        auto r = _mm_or_si128(_mm_or_si128(pick('A', '1', 'A'), pick('C', '2', 'C')),
+                              _mm_or_si128(pick('G', '3', 'G'), pick('T', '4', 'T')));
+        r = _mm_or_si128(r, pick('0', '0', 'N'));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(r, zero)) != 0)
+            break;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+    }
+#else
+    (void) s;
+    (void) n;
+    (void) out;
+#endif
+
+    return i;
+}
+
+} // namespace
+
+extern const Kernel table = { GCONV_STR(GCONV_KERNEL_NS), delim_mask, count_codes, diploid_stats, ped_calls };
+
+} // namespace GCONV_KERNEL_NS
+
+
+#ifdef GCONV_KERNEL_DISPATCH
+
+#ifdef GCONV_KERNEL_V2
+namespace kernel_v2 { extern const Kernel table; }
+#endif
+
+#ifdef GCONV_KERNEL_V3
+namespace kernel_v3 { extern const Kernel table; }
+#endif
+
+namespace {
+
+const Kernel& select_kernel()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+#ifdef GCONV_KERNEL_V3
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma"))
+        return kernel_v3::table;
+#endif
+#ifdef GCONV_KERNEL_V2
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return kernel_v2::table;
+#endif
+#endif
+    return kernel_base::table;
+}
+
+} // namespace
+
+const Kernel& kernel()
+{
+    static const Kernel &k = select_kernel();
+    return k;
+}
+
+#endif // GCONV_KERNEL_DISPATCH
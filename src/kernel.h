@@ -0,0 +1,67 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Hot loops built for several x86-64 ISA levels
+//
+//   kernel.cpp is compiled once for the baseline, and by the CMake build once more per
+//   ISA level (x86-64-v2, x86-64-v3) into its own namespace. kernel() returns the table
+//   of the best level the running CPU supports. Kernel code must not call inline library
+//   templates, whose ISA specific copies could otherwise be shared with other code.
+//
+
+struct Kernel
+{
+    const char *isa;
+
+    // set bit i of mask[i/64] if s[i] is a or b, mask has (n+63)/64 words
+    void (*delim_mask)(const char *s, std::size_t n, char a, char b, std::uint64_t *mask);
+
+    // add the number of bytes 0, 1, 2 and 3 of s to count[0..3], other bytes are not counted
+    void (*count_codes)(const unsigned char *s, std::size_t n, std::uint64_t *count);
+
+    // n diploid genotypes of one byte allele codes, 0 missing: add genotypes with a missing
+    // allele to *missing and called ones of different alleles to *het, increment miss[i] if
+    // genotype i is missing and miss is not null
+    void (*diploid_stats)(const unsigned char *s, std::size_t n, std::uint64_t *missing, std::uint64_t *het,
+                          std::uint32_t *miss);
+
+    // n PED calls of one character, each followed by a space (s has 2n bytes): write 1-4 and
+    // ACGT as ACGT and 0 as N to out, return the number of leading calls decoded, which stops
+    // early at any other byte
+    std::size_t (*ped_calls)(const char *s, std::size_t n, unsigned char *out);
+};
+
+
+const Kernel& kernel();
+
+
+// index of the lowest set bit, x must be non-zero
+inline int lowest_bit(std::uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return static_cast<int>(i);
+#elif defined(_MSC_VER)
+    int i = 0;
+    while ( ! (x & 1) ) {
+        x >>= 1;
+        ++i;
+    }
+    return i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+
+#endif // KERNEL_H
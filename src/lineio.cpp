@@ -0,0 +1,317 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include "lineio.h"
+#include "log.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+const std::size_t block_size = 1 << 20;
+
+#ifdef _WIN32
+
+int open_read(const std::string &filename)
+{
+    if (filename == "-") {
+        _setmode(0, _O_BINARY);
+        return 0;
+    }
+    return _open(filename.c_str(), _O_RDONLY | _O_BINARY);
+}
+
+long long read_some(int fd, char *buf, std::size_t n)
+{
+    return _read(fd, buf, static_cast<unsigned>(n));
+}
+
+void close_read(int fd)
+{
+    if (fd > 0)
+        _close(fd);
+}
+
+#else
+
+int open_read(const std::string &filename)
+{
+    return filename == "-" ? 0 : open(filename.c_str(), O_RDONLY);
+}
+
+long long read_some(int fd, char *buf, std::size_t n)
+{
+    ssize_t r;
+    do {
+        r = read(fd, buf, n);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+void close_read(int fd)
+{
+    if (fd > 0)
+        close(fd);
+}
+
+#endif
+
+} // namespace
+
+
+LineReader::LineReader(const std::string &filename, Progress *progress)
+    : filename_(filename), progress_(progress), ln_(0), ok_(false)
+{
+    fd_ = open_read(filename);
+    ok_ = fd_ >= 0;
+
+    if ( ok_ )
+        thread_ = std::thread(&LineReader::read_ahead, this);
+}
+
+LineReader::~LineReader()
+{
+    if ( thread_.joinable() ) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    close_read(fd_);
+}
+
+void LineReader::read_ahead()
+{
+    std::string buf;
+
+    for (;;) {
+        // a short read is handed over as it is, a pipe is not waited on to fill a block
+        buf.resize(block_size);
+        auto r = read_some(fd_, &buf[0], block_size);
+        buf.resize(r > 0 ? static_cast<std::size_t>(r) : 0);
+        bool eof = buf.empty();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return ! ready_ || stop_; });
+        if ( stop_ )
+            return;
+
+        next_.swap(buf);
+        ready_ = true;
+        eof_ = eof;
+        error_ = r < 0;
+        cv_.notify_all();
+
+        if ( eof )
+            return;
+    }
+}
+
+// swap in the block read ahead, false at the end of file or on a read error
+bool LineReader::next_block()
+{
+    if ( ! thread_.joinable() )
+        return false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return ready_; });
+
+    cur_.swap(next_);
+    pos_ = 0;
+    ready_ = false;
+
+    if ( eof_ ) {
+        lock.unlock();
+        thread_.join();
+        if ( error_ )
+            log_stream() << "ERROR: failed to read file: " << filename_ << "\n";
+        return false;
+    }
+
+    cv_.notify_all();
+
+    return true;
+}
+
+bool LineReader::getline(std::string &line)
+{
+    line.clear();
+
+    bool any = false;
+
+    for (;;) {
+        if (pos_ == cur_.size() && ! next_block())
+            break;
+
+        any = true;
+
+        auto p = cur_.data() + pos_;
+        auto n = cur_.size() - pos_;
+        auto q = static_cast<const char*>(std::memchr(p, '\n', n));
+
+        if ( q ) {
+            line.append(p, q - p);
+            pos_ += q - p + 1;
+            break;
+        }
+
+        line.append(p, n);
+        pos_ = cur_.size();
+    }
+
+    if ( ! any )
+        return false;
+
+    ++ln_;
+
+    if ( progress_ && ! progress_->add(line.size() + 1, 1) )
+        return false;
+
+    if ( ! line.empty() && line.back() == '\r' )
+        line.pop_back();
+
+    return true;
+}
+
+
+WriteBehindBuf::~WriteBehindBuf()
+{
+    close();
+}
+
+bool WriteBehindBuf::open(const std::string &filename)
+{
+    if (filename == "-")
+        out_ = &std::cout;
+    else {
+        file_.open(filename);
+        if ( ! file_ )
+            return false;
+        out_ = &file_;
+    }
+
+    stop_ = false;
+    error_ = false;
+    busy_ = false;
+
+    front_.resize(block_size);
+    setp(&front_[0], &front_[0] + front_.size());
+
+    thread_ = std::thread(&WriteBehindBuf::write_behind, this);
+
+    return true;
+}
+
+bool WriteBehindBuf::close()
+{
+    if ( ! thread_.joinable() )
+        return ! error_;
+
+    submit(true);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+
+    if (out_ == &file_)
+        file_.close();
+    else
+        out_->flush();
+
+    if ( ! *out_ )
+        error_ = true;
+
+    out_ = nullptr;
+    setp(nullptr, nullptr);
+
+    return ! error_;
+}
+
+void WriteBehindBuf::write_behind()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;) {
+        cv_.wait(lock, [this] { return busy_ || stop_; });
+        if ( ! busy_ )
+            return;
+
+        lock.unlock();
+        out_->write(back_.data(), back_.size());
+        bool ok = static_cast<bool>(*out_);
+        lock.lock();
+
+        if ( ! ok )
+            error_ = true;
+
+        busy_ = false;
+        cv_.notify_all();
+    }
+}
+
+// hand the filled part of the buffer to the I/O thread, optionally waiting until written
+bool WriteBehindBuf::submit(bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return ! busy_; });
+
+    if ( error_ )
+        return false;
+
+    auto n = static_cast<std::size_t>(pptr() - pbase());
+
+    if (n > 0) {
+        front_.resize(n);
+        front_.swap(back_);
+        busy_ = true;
+        cv_.notify_all();
+
+        front_.resize(block_size);
+        setp(&front_[0], &front_[0] + front_.size());
+    }
+
+    if ( wait )
+        cv_.wait(lock, [this] { return ! busy_; });
+
+    return ! error_;
+}
+
+WriteBehindBuf::int_type WriteBehindBuf::overflow(int_type c)
+{
+    if ( ! thread_.joinable() || ! submit(false) )
+        return traits_type::eof();
+
+    if ( ! traits_type::eq_int_type(c, traits_type::eof()) ) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+}
+
+int WriteBehindBuf::sync()
+{
+    if ( ! thread_.joinable() )
+        return 0;
+
+    if ( ! submit(true) )
+        return -1;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    out_->flush();
+
+    return *out_ ? 0 : -1;
+}
@@ -0,0 +1,141 @@
+#ifndef LINEIO_H
+#define LINEIO_H
+
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <condition_variable>
+#include "progress.h"
+
+
+// Line oriented text file reader
+//
+//   Trailing '\r' of DOS line endings is removed, and the bytes and lines read are
+//   reported to the progress monitor if one is given. Reading stops when the
+//   progress is cancelled.
+//
+//   The file is read ahead in blocks of up to 1 MB by an I/O thread, which fills the
+//   next block while lines of the current one are parsed. A block is handed over with
+//   whatever a read returns, so input from a pipe is parsed as it arrives. The file
+//   name "-" is stdin.
+//
+
+class LineReader
+{
+public:
+    explicit LineReader(const std::string &filename, Progress *progress = nullptr);
+
+    ~LineReader();
+
+    explicit operator bool() const { return ok_; }
+
+    // false at the end of file, on a read error or once the progress is cancelled
+    bool getline(std::string &line);
+
+    std::uint64_t line_number() const { return ln_; }
+
+    // a read failed, which getline has reported
+    bool error() const { return error_; }
+
+private:
+    bool next_block();
+
+    void read_ahead();
+
+private:
+    std::string filename_;
+    int fd_ = -1;
+    Progress *progress_;
+    std::uint64_t ln_;
+    bool ok_;
+
+    std::string cur_;
+    std::size_t pos_ = 0;
+
+    // block being read by the I/O thread, ready_ once it is filled
+    std::string next_;
+    bool ready_ = false;
+    bool eof_ = false;
+    bool error_ = false;
+    bool stop_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
+
+// Text file output stream with write-behind
+//
+//   Used in place of std::ofstream: a full buffer is written to the file by an I/O
+//   thread while the next one is filled. Write errors set badbit, at the latest when
+//   the file is closed. The file name "-" is stdout, which is flushed but not closed.
+//
+
+class WriteBehindBuf : public std::streambuf
+{
+public:
+    WriteBehindBuf() {}
+
+    ~WriteBehindBuf();
+
+    bool open(const std::string &filename);
+
+    bool is_open() const { return out_ != nullptr; }
+
+    // flush and close the file, false on any write error
+    bool close();
+
+protected:
+    int_type overflow(int_type c);
+
+    int sync();
+
+private:
+    bool submit(bool wait);
+
+    void write_behind();
+
+private:
+    std::ofstream file_;
+    std::ostream *out_ = nullptr;
+    std::string front_;
+    std::string back_;
+    bool busy_ = false;
+    bool stop_ = false;
+    bool error_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
+class LineWriter : public std::ostream
+{
+public:
+    LineWriter() : std::ostream(&buf_) {}
+
+    explicit LineWriter(const std::string &filename) : std::ostream(&buf_) { open(filename); }
+
+    void open(const std::string &filename)
+    {
+        if ( ! buf_.open(filename) )
+            setstate(std::ios::failbit);
+    }
+
+    bool is_open() const { return buf_.is_open(); }
+
+    void close()
+    {
+        if ( ! buf_.close() )
+            setstate(std::ios::badbit);
+    }
+
+private:
+    WriteBehindBuf buf_;
+};
+
+
+#endif // LINEIO_H
@@ -0,0 +1,80 @@
+#include <iostream>
+#include "log.h"
+
+
+namespace {
+
+thread_local LogScope *current = nullptr;
+
+} // namespace
+
+
+class LogScope::Buffer : public std::streambuf
+{
+public:
+    explicit Buffer(LogHandler handler) : handler_(std::move(handler)) {}
+
+    const LogHandler& handler() const { return handler_; }
+
+    void flush()
+    {
+        if ( ! line_.empty() ) {
+            handler_(line_);
+            line_.clear();
+        }
+    }
+
+protected:
+    int_type overflow(int_type c)
+    {
+        if (c == traits_type::eof())
+            return traits_type::not_eof(c);
+
+        line_.push_back(static_cast<char>(c));
+        if (c == '\n')
+            flush();
+
+        return c;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n)
+    {
+        for (std::streamsize i = 0; i < n; ++i)
+            overflow(traits_type::to_int_type(s[i]));
+        return n;
+    }
+
+private:
+    LogHandler handler_;
+    std::string line_;
+};
+
+
+std::ostream& log_stream()
+{
+    return current && current->os_ ? *current->os_ : std::cerr;
+}
+
+LogHandler log_handler()
+{
+    return current && current->buf_ ? current->buf_->handler() : LogHandler();
+}
+
+LogScope::LogScope(LogHandler handler)
+    : prev_(current)
+{
+    if ( handler ) {
+        buf_.reset(new Buffer(std::move(handler)));
+        os_.reset(new std::ostream(buf_.get()));
+    }
+
+    current = this;
+}
+
+LogScope::~LogScope()
+{
+    if ( buf_ )
+        buf_->flush();
+
+    current = prev_;
+}
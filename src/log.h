@@ -0,0 +1,59 @@
+#ifndef LOG_H
+#define LOG_H
+
+
+#include <memory>
+#include <string>
+#include <ostream>
+#include <functional>
+
+
+// Diagnostic messages of the library
+//
+//   Readers, writers and the conversion pipeline write INFO and ERROR lines to
+//   log_stream(), which is std::cerr unless the calling thread has a LogScope:
+//
+//     LogScope scope([](const std::string &line) { ... });
+//     load_genotype(Format::vcf, { "in.vcf" }, gt);
+//
+//   Each complete line, newline included, is then passed to the handler instead, and
+//   std::cerr is left alone. Threads started by the library log to the handler of the
+//   thread that starts them, so the handler may be called from several threads at once.
+//
+
+
+using LogHandler = std::function<void(const std::string &line)>;
+
+
+std::ostream& log_stream();
+
+// handler of the calling thread, empty if it logs to std::cerr
+LogHandler log_handler();
+
+
+class LogScope
+{
+public:
+    // an empty handler logs to std::cerr
+    explicit LogScope(LogHandler handler);
+
+    // passes on an incomplete last line
+    ~LogScope();
+
+    LogScope(const LogScope &) = delete;
+
+    LogScope& operator=(const LogScope &) = delete;
+
+private:
+    friend std::ostream& log_stream();
+    friend LogHandler log_handler();
+
+    class Buffer;
+
+    std::unique_ptr<Buffer> buf_;
+    std::unique_ptr<std::ostream> os_;
+    LogScope *prev_;
+};
+
+
+#endif // LOG_H
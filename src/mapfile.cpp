@@ -0,0 +1,91 @@
+#include <limits>
+#include <cstdint>
+#include "mapfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER n;
+    if ( ! GetFileSizeEx(file, &n) || n.QuadPart <= 0
+        || static_cast<std::uint64_t>(n.QuadPart) > std::numeric_limits<std::size_t>::max() ) {
+        CloseHandle(file);
+        return;
+    }
+
+    auto map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if ( ! map ) {
+        CloseHandle(file);
+        return;
+    }
+
+    auto p = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if ( ! p ) {
+        CloseHandle(map);
+        CloseHandle(file);
+        return;
+    }
+
+    file_ = file;
+    map_ = map;
+    data_ = static_cast<const char*>(p);
+    size_ = static_cast<std::size_t>(n.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    if ( data_ ) {
+        UnmapViewOfFile(data_);
+        CloseHandle(map_);
+        CloseHandle(file_);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ! S_ISREG(st.st_mode) || st.st_size <= 0
+        || static_cast<std::uint64_t>(st.st_size) > std::numeric_limits<std::size_t>::max()) {
+        close(fd);
+        return;
+    }
+
+    auto n = static_cast<std::size_t>(st.st_size);
+    auto p = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return;
+
+    data_ = static_cast<const char*>(p);
+    size_ = n;
+}
+
+MappedFile::~MappedFile()
+{
+    if ( data_ )
+        munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
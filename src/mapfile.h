@@ -0,0 +1,42 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+
+#include <string>
+#include <cstddef>
+
+
+// Read-only memory mapping of a whole file
+//
+//   The mapping fails for empty files and where the address space is too small for
+//   the file, callers fall back to reading it as a stream.
+//
+
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile& operator=(const MappedFile &) = delete;
+
+    explicit operator bool() const { return data_ != nullptr; }
+
+    const char* data() const { return data_; }
+
+    std::size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *map_ = nullptr;
+#endif
+};
+
+
+#endif // MAPFILE_H
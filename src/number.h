@@ -0,0 +1,156 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#include "split.h"
+
+
+// Locale independent number parsing in the manner of std::from_chars
+//
+//   The whole token must be a number, no temporary string is created. Leading '+' is
+//   accepted. False is returned on invalid input or integer overflow.
+//
+
+template<typename T>
+bool parse_integer(const char *s, std::size_t n, T &x)
+{
+    static_assert(std::is_integral<T>::value && std::is_signed<T>::value, "signed integer required");
+
+    using U = typename std::make_unsigned<T>::type;
+
+    std::size_t i = 0;
+    bool neg = false;
+
+    if (n > 0 && (s[0] == '-' || s[0] == '+')) {
+        neg = s[0] == '-';
+        i = 1;
+    }
+
+    if (i == n)
+        return false;
+
+    U lim = static_cast<U>(std::numeric_limits<T>::max()) + (neg ? 1 : 0);
+    U v = 0;
+
+    for (; i < n; ++i) {
+        unsigned d = static_cast<unsigned char>(s[i]) - static_cast<unsigned>('0');
+        if (d > 9 || v > (lim - d) / 10)
+            return false;
+        v = v * 10 + d;
+    }
+
+    x = neg ? static_cast<T>(0 - v) : static_cast<T>(v);
+
+    return true;
+}
+
+// strtod in the "C" locale, a program such as the GUI may set one of a decimal comma
+inline double strtod_c(const char *s, char **end)
+{
+#ifdef _WIN32
+    static const _locale_t loc = _create_locale(LC_NUMERIC, "C");
+    return _strtod_l(s, end, loc);
+#else
+    static const locale_t loc = newlocale(LC_NUMERIC_MASK, "C", static_cast<locale_t>(0));
+    return strtod_l(s, end, loc);
+#endif
+}
+
+// decimal numbers of at most 19 significant digits and a power of ten within 1e+/-22
+// are exact in double arithmetic; others, inf and nan are left to strtod_c
+inline bool parse_double(const char *s, std::size_t n, double &x)
+{
+    static const double p10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    std::size_t i = 0;
+    bool neg = false;
+
+    if (n > 0 && (s[0] == '-' || s[0] == '+')) {
+        neg = s[0] == '-';
+        i = 1;
+    }
+
+    std::uint64_t m = 0;
+    int digits = 0, exp = 0;
+    bool any = false, exact = true;
+
+    for (; i < n && s[i] >= '0' && s[i] <= '9'; ++i) {
+        any = true;
+        if (digits < 19) {
+            m = m * 10 + static_cast<unsigned>(s[i] - '0');
+            if (m != 0)
+                ++digits;
+        }
+        else {
+            ++exp;
+            exact = exact && s[i] == '0';
+        }
+    }
+
+    if (i < n && s[i] == '.') {
+        for (++i; i < n && s[i] >= '0' && s[i] <= '9'; ++i) {
+            any = true;
+            if (digits < 19) {
+                m = m * 10 + static_cast<unsigned>(s[i] - '0');
+                if (m != 0)
+                    ++digits;
+                --exp;
+            }
+            else
+                exact = exact && s[i] == '0';
+        }
+    }
+
+    if (any && i < n && (s[i] == 'e' || s[i] == 'E')) {
+        int e = 0;
+        if (parse_integer(s + i + 1, n - i - 1, e) && e > -1000 && e < 1000) {
+            exp += e;
+            i = n;
+        }
+    }
+
+    if (any && i == n && exact && m < (std::uint64_t(1) << 53) && exp >= -22 && exp <= 22) {
+        auto v = static_cast<double>(m);
+        v = exp < 0 ? v / p10[-exp] : v * p10[exp];
+        x = neg ? -v : v;
+        return true;
+    }
+
+    char buf[64];
+    if (n == 0 || n >= sizeof buf)
+        return false;
+
+    std::memcpy(buf, s, n);
+    buf[n] = '\0';
+
+    char *end = nullptr;
+    x = strtod_c(buf, &end);
+
+    return end == buf + n;
+}
+
+template<typename T>
+bool parse_integer(const Token &t, T &x)
+{
+    return parse_integer(t.data(), t.size(), x);
+}
+
+inline bool parse_double(const Token &t, double &x)
+{
+    return parse_double(t.data(), t.size(), x);
+}
+
+
+#endif // NUMBER_H
@@ -1,9 +1,14 @@
 #include <unordered_set>
-#include <fstream>
 #include <iostream>
 #include <algorithm>
 #include "ped.h"
 #include "split.h"
+#include "number.h"
+#include "kernel.h"
+#include "lineio.h"
+#include "log.h"
+#include "progress.h"
+#include "summary.h"
 
 
 using std::size_t;
@@ -23,58 +28,96 @@ bool has_duplicate(const std::vector<T> &v)
     return false;
 }
 
-// fid_iid -> fid iid, otherwise, fid = 1,2,... iid = ind
-void parse_fid_iid(const std::vector<std::string> &ind, std::vector<std::string> &fid, std::vector<std::string> &iid)
+// allele of each call character, 1-4 are ACGT and 0 is missing (N), 0 if invalid
+struct PedCodes
 {
-    auto n = ind.size();
-    for (auto &e : ind) {
-        std::vector<std::string> vs;
-        split(e, "_", vs);
-        if (vs.size() == 2) {
-            fid.push_back(vs[0]);
-            iid.push_back(vs[1]);
-        }
-        else {
-            iid = ind;
-            fid.clear();
-            for (size_t i = 0; i < n; ++i)
-                fid.push_back(std::to_string(i+1));
-            break;
-        }
+    char code[256];
+
+    PedCodes()
+    {
+        std::fill(code, code + 256, 0);
+        for (auto c : { 'A', 'C', 'G', 'T' })
+            code[static_cast<unsigned char>(c)] = c;
+        code['1'] = 'A';
+        code['2'] = 'C';
+        code['3'] = 'G';
+        code['4'] = 'T';
+        code['0'] = 'N';
     }
-}
+};
+
+const PedCodes ped_codes;
 
 int parse_ped_gt(const char *s, size_t n, char &a)
 {
     if (n != 1) {
-        std::cerr << "ERROR: PED genotype must be represented by 1 character: " << std::string(s, n) << "\n";
+        log_stream() << "ERROR: PED genotype must be represented by 1 character: " << std::string(s, n) << "\n";
         return 1;
     }
 
-    a = s[0];
+    a = ped_codes.code[static_cast<unsigned char>(s[0])];
 
-    if (a == '1') a = 'A';
-    else if (a == '2') a = 'C';
-    else if (a == '3') a = 'G';
-    else if (a == '4') a = 'T';
-    else if (a == '0') a = 'N';
-    else if (a != 'A' && a != 'C' && a != 'G' && a != 'T') {
-        std::cerr << "ERROR: invalid PED genotype code: " << std::string(s, n) << "\n";
+    if (a == 0) {
+        log_stream() << "ERROR: invalid PED genotype code: " << std::string(s, n) << "\n";
         return 2;
     }
 
     return 0;
 }
 
-int check_compat_ped(const Genotype &gt)
+// the first n columns of s, offset of the column after them or npos if there is none
+size_t split_columns(const std::string &s, size_t n, std::vector<Token> &v)
+{
+    auto i = s.find_first_not_of(" \t");
+
+    for (size_t k = 0; k < n && i != std::string::npos; ++k) {
+        auto j = s.find_first_of(" \t", i);
+        if (j == std::string::npos)
+            return j;
+        v.emplace_back(s.data() + i, j - i);
+        i = s.find_first_not_of(" \t", j);
+    }
+
+    return i;
+}
+
+// calls of one character separated by single spaces, the usual PLINK layout; false if the
+// text is laid out otherwise or has an invalid call, the generic path handles it then
+bool decode_ped_calls(const char *s, size_t len, std::vector<allele_t> &gt)
+{
+    if (len % 2 == 0)
+        return false;
+
+    auto n = (len + 1) / 2;
+    gt.resize(n);
+
+    auto out = gt.data();
+    auto code = ped_codes.code;
+
+    // the last call has no space
+    for (auto i = kernel().ped_calls(s, n - 1, out); i < n; ++i) {
+        auto a = code[static_cast<unsigned char>(s[i*2])];
+        if (a == 0 || (i + 1 < n && s[i*2+1] != ' '))
+            return false;
+        out[i] = static_cast<allele_t>(a);
+    }
+
+    return true;
+}
+
+int check_compat_ped(const Genotype &gt, const std::vector<size_t> *loci)
 {
-    for (auto &v : gt.allele) {
-        if (v.size() > 2)
+    if (gt.ploidy > 2)
+        return 3;
+
+    // alleles only, recorded flags save the string scans
+    for (size_t k = 0, m = locus_count(gt, loci); k < m; ++k) {
+        auto j = locus_index(loci, k);
+        auto flag = j < gt.flag.size() ? gt.flag[j] : allele_flags(gt.allele[j]);
+        if ( ! (flag & LOCUS_BIALLELIC) )
             return 1;
-        for (auto &e : v) {
-            if (e != "A" && e != "C" && e != "G" && e != "T")
-                return 2;
-        }
+        if ( ! (flag & LOCUS_ACGT) )
+            return 2;
     }
 
     return 0;
@@ -83,13 +126,40 @@ int check_compat_ped(const Genotype &gt)
 } // namespace
 
 
+void parse_fid_iid(const std::vector<std::string> &ind, std::vector<std::string> &fid, std::vector<std::string> &iid)
+{
+    auto n = ind.size();
+    for (auto &e : ind) {
+        std::vector<std::string> vs;
+        split(e, "_", vs);
+        if (vs.size() == 2) {
+            fid.push_back(vs[0]);
+            iid.push_back(vs[1]);
+        }
+        else {
+            iid = ind;
+            fid.clear();
+            for (size_t i = 0; i < n; ++i)
+                fid.push_back(std::to_string(i+1));
+            break;
+        }
+    }
+}
+
 int parse_ped_entry(const std::string &s, PedEntry &e)
 {
     std::vector<Token> v;
-    split(s, " \t", v);
+
+    auto p = split_columns(s, 6, v);
+    bool fast = p != std::string::npos && decode_ped_calls(s.data() + p, s.size() - p, e.gt);
+
+    if ( ! fast ) {
+        v.clear();
+        split(s, " \t", v);
+    }
 
     if (v.size() < 6) {
-        std::cerr << "ERROR: incorrect number of columns at PED entry line: " << v.size() << "\n";
+        log_stream() << "ERROR: incorrect number of columns at PED entry line: " << v.size() << "\n";
         return 1;
     }
 
@@ -97,8 +167,16 @@ int parse_ped_entry(const std::string &s, PedEntry &e)
     e.iid = v[1].to_string();
     e.pid = v[2].to_string();
     e.mid = v[3].to_string();
-    e.sex = std::stoi(v[4].to_string());
-    e.pheno = std::stod(v[5].to_string());
+
+    // non-numeric sex codes are unknown, phenotypes such as NA are missing
+    if ( ! parse_integer(v[4], e.sex) )
+        e.sex = 0;
+
+    if ( ! parse_double(v[5], e.pheno) )
+        e.pheno = -9;
+
+    if ( fast )
+        return 0;
 
     e.gt.clear();
     for (auto itr = v.begin() + 6; itr != v.end(); ++itr) {
@@ -113,47 +191,57 @@ int parse_ped_entry(const std::string &s, PedEntry &e)
 
 int parse_map_entry(const std::string &s, MapEntry &e)
 {
-    std::vector<std::string> v;
+    std::vector<Token> v;
     split(s, " \t", v);
 
     if (v.size() != 4) {
-        std::cerr << "ERROR: expected 4 columns at MAP entry line: " << v.size() << "\n";
+        log_stream() << "ERROR: expected 4 columns at MAP entry line: " << v.size() << "\n";
         return 1;
     }
 
-    e.chr = v[0];
-    e.id = v[1];
-    e.dist = std::stod(v[2]);
-    e.pos = std::stoi(v[3]);
+    e.chr = v[0].to_string();
+    e.id = v[1].to_string();
+
+    if ( ! parse_double(v[2], e.dist) ) {
+        log_stream() << "ERROR: invalid genetic distance: " << v[2].to_string() << "\n";
+        return 1;
+    }
+
+    if ( ! parse_integer(v[3], e.pos) ) {
+        log_stream() << "ERROR: invalid position: " << v[3].to_string() << "\n";
+        return 1;
+    }
 
     return 0;
 }
 
-int read_ped(const std::string &filename, Genotype &gt)
+int read_ped(const std::string &filename, Genotype &gt, Progress *progress, GenotypeSummary *summary)
 {
-    std::ifstream ifsm(filename + ".map");
+    LineReader ifsm(filename + ".map", progress);
     if ( ! ifsm ) {
-        std::cerr << "ERROR: can't open file for reading: " << filename << ".map\n";
+        log_stream() << "ERROR: can't open file for reading: " << filename << ".map\n";
         return 1;
     }
 
     MapEntry me;
 
-    for (std::string line; std::getline(ifsm, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
-
-        if (parse_map_entry(line, me) != 0)
+    for (std::string line; ifsm.getline(line); ) {
+        if (parse_map_entry(line, me) != 0) {
+            log_stream() << "ERROR: invalid MAP entry at line " << ifsm.line_number() << "\n";
             return 1;
+        }
 
         gt.loc.push_back(me.id);
         gt.chr.push_back(me.chr);
         gt.pos.push_back(me.pos);
     }
 
-    std::ifstream ifsp(filename + ".ped");
+    if (ifsm.error() || (progress && progress->cancelled()))
+        return 1;
+
+    LineReader ifsp(filename + ".ped", progress);
     if ( ! ifsp ) {
-        std::cerr << "ERROR: can't open file for reading: " << filename << ".ped\n";
+        log_stream() << "ERROR: can't open file for reading: " << filename << ".ped\n";
         return 1;
     }
 
@@ -161,15 +249,15 @@ int read_ped(const std::string &filename, Genotype &gt)
     std::vector<std::string> iid, iid2;
     std::vector< std::vector<allele_t> > dat;
 
-    for (std::string line; std::getline(ifsp, line); ) {
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
-
-        if (parse_ped_entry(line, pe) != 0)
+    for (std::string line; ifsp.getline(line); ) {
+        if (parse_ped_entry(line, pe) != 0) {
+            log_stream() << "ERROR: invalid PED entry at line " << ifsp.line_number() << "\n";
             return 1;
+        }
 
         if (pe.gt.size() != 2 * gt.loc.size()) {
-            std::cerr << "ERROR: column count doesn't match at " << pe.fid << ", " << pe.iid << "\n";
+            log_stream() << "ERROR: column count doesn't match at line " << ifsp.line_number() << ": "
+                      << pe.fid << ", " << pe.iid << "\n";
             return 1;
         }
 
@@ -178,6 +266,9 @@ int read_ped(const std::string &filename, Genotype &gt)
         dat.push_back(pe.gt);
     }
 
+    if (ifsp.error() || (progress && progress->cancelled()))
+        return 1;
+
     if ( has_duplicate(iid) )
         gt.ind.swap(iid2);
     else
@@ -187,11 +278,19 @@ int read_ped(const std::string &filename, Genotype &gt)
     auto n = dat.size();
     std::vector<std::string> as;
 
+    if ( summary )
+        summary->begin(gt.ind);
+
+    // loci failing the summary filter are dropped, k loci are kept
+    size_t k = 0;
+
     for (size_t j = 0; j < m; ++j) {
         std::vector<allele_t> v;
+        bool het = false;
         for (size_t i = 0; i < n; ++i) {
             v.push_back(dat[i][j*2]);
             v.push_back(dat[i][j*2+1]);
+            het = het || dat[i][j*2] != dat[i][j*2+1];
         }
 
         auto z = v;
@@ -199,10 +298,10 @@ int read_ped(const std::string &filename, Genotype &gt)
         z.erase(std::unique(z.begin(), std::remove(z.begin(), z.end(), 'N')), z.end());
 
         if (z.size() > 2) {
-            std::cerr << "ERROR: PED variant must be bi-allelic: " << z[0];
+            log_stream() << "ERROR: PED variant must be bi-allelic: " << z[0];
             for (size_t i = 1; i < z.size(); ++i)
-                std::cerr << "/" << z[i];
-            std::cerr << "\n";
+                log_stream() << "/" << z[i];
+            log_stream() << "\n";
             return 1;
         }
 
@@ -226,36 +325,55 @@ int read_ped(const std::string &filename, Genotype &gt)
                 a = 2;
         }
 
-        gt.dat.push_back(v);
+        if (summary && ! summary->add(gt.loc[j], gt.chr[j], gt.pos[j], as, v))
+            continue;
+
+        if (k != j) {
+            gt.loc[k].swap(gt.loc[j]);
+            gt.chr[k].swap(gt.chr[j]);
+            gt.pos[k] = gt.pos[j];
+        }
+        ++k;
+
         gt.allele.push_back(as);
+        gt.flag.push_back(allele_flags(as) | (het ? LOCUS_HET : 0));
+
+        if (make_sparse(v, as.size()))
+            gt.flag.back() |= LOCUS_SPARSE;
+
+        gt.dat.push_back(v);
     }
 
+    gt.loc.resize(k);
+    gt.chr.resize(k);
+    gt.pos.resize(k);
+
     gt.ploidy = 2;
 
     return 0;
 }
 
-int write_ped(const Genotype &gt, const std::string &filename)
+int write_ped(const Genotype &gt, const std::string &filename, Progress *progress, const std::vector<size_t> *loci)
 {
-    int info = check_compat_ped(gt);
+    int info = check_compat_ped(gt, loci);
     if (info != 0) {
-        std::cerr << "ERROR: genotype data is not compatible with PED format: " << info << "\n";
+        log_stream() << "ERROR: genotype data is not compatible with PED format: " << info << "\n";
         return 1;
     }
 
-    std::ofstream ofsm(filename + ".ped");
+    LineWriter ofsm(filename + ".ped");
     if ( ! ofsm ) {
-        std::cerr << "ERROR: can't open file for writing: " << filename << ".ped\n";
+        log_stream() << "ERROR: can't open file for writing: " << filename << ".ped\n";
         return 1;
     }
 
-    std::ofstream ofsp(filename + ".map");
+    LineWriter ofsp(filename + ".map");
     if ( ! ofsp ) {
-        std::cerr << "ERROR: can't open file for writing: " << filename << ".map\n";
+        log_stream() << "ERROR: can't open file for writing: " << filename << ".map\n";
         return 1;
     }
 
-    auto m = gt.loc.size();
+    auto m = locus_count(gt, loci);
     auto n = gt.ind.size();
     bool haploid = gt.ploidy != 2;
 
@@ -264,13 +382,33 @@ int write_ped(const Genotype &gt, const std::string &filename)
 
     std::string line;
 
+    // next entry of each sparse locus, samples are written in order
+    std::vector<size_t> next(m, sparse_header + 1);
+    std::vector<char> sparse(m, 0);
+    for (size_t k = 0; k < m; ++k) {
+        auto j = locus_index(loci, k);
+        sparse[k] = j < gt.flag.size() && (gt.flag[j] & LOCUS_SPARSE);
+    }
+
     for (size_t i = 0; i < n; ++i) {
+        if (progress && ! progress->add(0, 1))
+            return 1;
+
         line.clear();
         auto k1 = haploid ? i : i * 2;
         auto k2 = haploid ? i : i * 2 + 1;
-        for (size_t j = 0; j < m; ++j) {
-            auto a = gt.dat[j][k1];
-            auto b = gt.dat[j][k2];
+        for (size_t k = 0; k < m; ++k) {
+            auto j = locus_index(loci, k);
+            auto &v = gt.dat[j];
+            unsigned a, b;
+            if ( sparse[k] ) {
+                a = sparse_allele(v, k1, 1, next[k]);
+                b = sparse_allele(v, k2, 1, next[k]);
+            }
+            else {
+                a = v[k1];
+                b = v[k2];
+            }
             if (a && b) {
                 line.push_back(' ');
                 line.append(gt.allele[j][a-1]);
@@ -283,8 +421,17 @@ int write_ped(const Genotype &gt, const std::string &filename)
         ofsm << fid[i] << " " << iid[i] << " 0 0 1 0" << line << "\n";
     }
 
-    for (size_t j = 0; j < m; ++j)
+    for (size_t k = 0; k < m; ++k) {
+        auto j = locus_index(loci, k);
         ofsp << gt.chr[j] << " " << gt.loc[j] << " 0 " << gt.pos[j] << "\n";
+    }
+
+    ofsm.close();
+    ofsp.close();
+    if ( ! ofsm || ! ofsp ) {
+        log_stream() << "ERROR: failed to write file: " << filename << ".ped/.map\n";
+        return 1;
+    }
 
     return 0;
 }
@@ -58,18 +58,22 @@ struct MapEntry
 {
     std::string chr;
     std::string id;
-    double dist;
-    int pos;
+    double dist = 0;
+    pos_t pos = 0;
 };
 
 
+// fid_iid -> fid iid, otherwise, fid = 1,2,... iid = ind
+void parse_fid_iid(const std::vector<std::string> &ind, std::vector<std::string> &fid, std::vector<std::string> &iid);
+
 int parse_ped_entry(const std::string &s, PedEntry &e);
 
 int parse_map_entry(const std::string &s, MapEntry &e);
 
-int read_ped(const std::string &filename, Genotype &gt);
+int read_ped(const std::string &filename, Genotype &gt, Progress *progress = nullptr, GenotypeSummary *summary = nullptr);
 
-int write_ped(const Genotype &gt, const std::string &filename);
+int write_ped(const Genotype &gt, const std::string &filename, Progress *progress = nullptr,
+              const std::vector<std::size_t> *loci = nullptr);
 
 
 #endif // PED_H
@@ -0,0 +1,170 @@
+#include <chrono>
+#include <fstream>
+#include "perf.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi")
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+
+double wall_time()
+{
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+double cpu_time()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if ( ! GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user) )
+        return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0.0;
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+#endif
+}
+
+std::uint64_t peak_rss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if ( ! GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) )
+        return 0;
+    return pmc.PeakWorkingSetSize;
+#elif defined(__linux__)
+    // VmHWM follows reset_peak_rss, ru_maxrss doesn't once a thread has exited
+    std::ifstream ifs("/proc/self/status");
+    for (std::string line; std::getline(ifs, line); ) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stoull(line.substr(6)) * 1024;
+    }
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<std::uint64_t>(ru.ru_maxrss);
+#else
+    return static_cast<std::uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool reset_peak_rss()
+{
+#ifdef __linux__
+    // Linux >= 4.0, "5" resets the peak RSS reported by getrusage and /proc/self/status
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0)
+        return false;
+    bool ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+std::uint64_t file_size(const std::string &filename)
+{
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if ( ! ifs )
+        return 0;
+
+    auto n = ifs.tellg();
+
+    return n < 0 ? 0 : static_cast<std::uint64_t>(n);
+}
+
+bool same_file(const std::string &filename1, const std::string &filename2)
+{
+#ifdef _WIN32
+    BY_HANDLE_FILE_INFORMATION info[2];
+    const std::string *names[2] = { &filename1, &filename2 };
+
+    for (int k = 0; k < 2; ++k) {
+        HANDLE h = CreateFileA(names[k]->c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+        if (h == INVALID_HANDLE_VALUE)
+            return false;
+        BOOL ok = GetFileInformationByHandle(h, &info[k]);
+        CloseHandle(h);
+        if ( ! ok )
+            return false;
+    }
+
+    return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber
+        && info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+#else
+    struct stat st1, st2;
+    if (stat(filename1.c_str(), &st1) != 0 || stat(filename2.c_str(), &st2) != 0)
+        return false;
+
+    return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+#endif
+}
+
+std::string make_temp_file(const std::string &prefix)
+{
+#ifdef _WIN32
+    // CREATE_NEW fails if the name is taken, try the next one then
+    auto pid = std::to_string(GetCurrentProcessId());
+    for (int k = 0; k < 1000; ++k) {
+        auto name = prefix + "." + pid + "." + std::to_string(k);
+        HANDLE h = CreateFileA(name.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (h != INVALID_HANDLE_VALUE) {
+            CloseHandle(h);
+            return name;
+        }
+        if (GetLastError() != ERROR_FILE_EXISTS)
+            break;
+    }
+    return std::string();
+#else
+    std::string s = prefix + ".XXXXXX";
+    std::vector<char> buf(s.begin(), s.end());
+    buf.push_back('\0');
+
+    int fd = mkstemp(buf.data());
+    if (fd < 0)
+        return std::string();
+    close(fd);
+
+    return std::string(buf.data());
+#endif
+}
+
+bool replace_file(const std::string &from, const std::string &to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    struct stat st;
+    if (stat(to.c_str(), &st) == 0)
+        chmod(from.c_str(), st.st_mode & 07777);
+
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
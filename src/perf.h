@@ -0,0 +1,35 @@
+#ifndef PERF_H
+#define PERF_H
+
+
+#include <string>
+#include <cstdint>
+
+
+// wall clock time in seconds since an arbitrary point
+double wall_time();
+
+// CPU time (user + system) in seconds consumed by the process
+double cpu_time();
+
+// peak resident set size in bytes, 0 if unavailable
+std::uint64_t peak_rss();
+
+// reset the peak resident set size to the current one, return false if unsupported
+bool reset_peak_rss();
+
+// file size in bytes, 0 if the file can't be opened
+std::uint64_t file_size(const std::string &filename);
+
+// true if both names refer to the same existing file, e.g. through a link
+bool same_file(const std::string &filename1, const std::string &filename2);
+
+// create a new empty file of a unique name beginning with prefix, which is returned;
+// empty if the file can't be created
+std::string make_temp_file(const std::string &prefix);
+
+// move a file over another one, which it replaces along with its permissions
+bool replace_file(const std::string &from, const std::string &to);
+
+
+#endif // PERF_H
@@ -0,0 +1,95 @@
+#include <cstdio>
+#include "progress.h"
+#include "perf.h"
+
+
+Progress::Progress(Callback callback, double interval)
+    : callback_(callback), bytes_(0), records_(0), total_bytes_(0), total_records_(0),
+      next_(0.0), cancelled_(false), interval_(interval), start_(wall_time())
+{
+}
+
+void Progress::begin(const std::string &stage, std::uint64_t total_bytes, std::uint64_t total_records)
+{
+    stage_ = stage;
+    bytes_ = 0;
+    records_ = 0;
+    total_bytes_ = total_bytes;
+    total_records_ = total_records;
+    start_ = wall_time();
+    next_ = start_ + interval_;
+}
+
+bool Progress::add(std::uint64_t bytes, std::uint64_t records)
+{
+    bytes_ += bytes;
+    records_ += records;
+
+    if ( callback_ ) {
+        auto now = wall_time();
+        auto next = next_.load();
+
+        // only the thread that moves the deadline reports
+        if (now >= next && next_.compare_exchange_strong(next, now + interval_))
+            notify();
+    }
+
+    return ! cancelled_;
+}
+
+void Progress::end()
+{
+    if ( callback_ )
+        notify();
+}
+
+double Progress::elapsed() const
+{
+    return wall_time() - start_;
+}
+
+double Progress::fraction() const
+{
+    double f = -1.0;
+
+    if (total_bytes_ > 0)
+        f = static_cast<double>(bytes_) / total_bytes_;
+    else if (total_records_ > 0)
+        f = static_cast<double>(records_) / total_records_;
+
+    return f > 1.0 ? 1.0 : f;
+}
+
+double Progress::records_per_second() const
+{
+    auto t = elapsed();
+    return t > 0 ? records_ / t : 0.0;
+}
+
+double Progress::eta() const
+{
+    auto f = fraction();
+    if (f <= 0)
+        return -1.0;
+    return elapsed() * (1.0 - f) / f;
+}
+
+std::string Progress::format() const
+{
+    char buf[256];
+
+    std::snprintf(buf, sizeof(buf), "\tbytes=%llu\ttotal_bytes=%llu\trecords=%llu\ttotal_records=%llu"
+                  "\trecords_per_s=%.1f\tmb_per_s=%.3f\tpercent=%.1f\teta_s=%.1f",
+                  static_cast<unsigned long long>(bytes_), static_cast<unsigned long long>(total_bytes_),
+                  static_cast<unsigned long long>(records_), static_cast<unsigned long long>(total_records_),
+                  records_per_second(), elapsed() > 0 ? bytes_ / 1e6 / elapsed() : 0.0,
+                  fraction() < 0 ? -1.0 : fraction() * 100, eta());
+
+    return "PROGRESS\tstage=" + stage_ + buf;
+}
+
+void Progress::notify()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_(*this);
+}
@@ -0,0 +1,84 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+
+// Progress of a long running conversion stage
+//
+//   Readers and writers call add() as lines are processed, which may happen from
+//   several threads. The callback is invoked at most once per interval, and once
+//   more when the stage ends.
+//
+//   The fraction done is measured in bytes if the total size is known, otherwise in
+//   records (lines) if the total number of records is known.
+//
+//   cancel() may be called from any thread, add() returns false from then on and
+//   readers and writers stop with an error.
+//
+
+class Progress
+{
+public:
+    using Callback = std::function<void(const Progress &)>;
+
+    explicit Progress(Callback callback = Callback(), double interval = 1.0);
+
+    void begin(const std::string &stage, std::uint64_t total_bytes = 0, std::uint64_t total_records = 0);
+
+    bool add(std::uint64_t bytes, std::uint64_t records);
+
+    void end();
+
+    void cancel() { cancelled_ = true; }
+
+    bool cancelled() const { return cancelled_; }
+
+    const std::string& stage() const { return stage_; }
+
+    std::uint64_t bytes() const { return bytes_; }
+
+    std::uint64_t records() const { return records_; }
+
+    std::uint64_t total_bytes() const { return total_bytes_; }
+
+    std::uint64_t total_records() const { return total_records_; }
+
+    // seconds since begin()
+    double elapsed() const;
+
+    // fraction done in [0,1], negative if unknown
+    double fraction() const;
+
+    double records_per_second() const;
+
+    // estimated seconds to the end of the stage, negative if unknown
+    double eta() const;
+
+    // structured single line: PROGRESS stage=... bytes=... total_bytes=... records=... ...
+    std::string format() const;
+
+private:
+    void notify();
+
+private:
+    Callback callback_;
+    std::string stage_;
+    std::atomic<std::uint64_t> bytes_;
+    std::atomic<std::uint64_t> records_;
+    std::atomic<std::uint64_t> total_bytes_;
+    std::atomic<std::uint64_t> total_records_;
+    std::atomic<double> next_;
+    std::atomic<bool> cancelled_;
+    std::mutex mutex_;
+    double interval_;
+    double start_;
+};
+
+
+#endif // PROGRESS_H
@@ -4,6 +4,8 @@
 
 #include <cstring>
 #include <string>
+#include <vector>
+#include "kernel.h"
 
 
 class Token
@@ -40,10 +42,34 @@ private:
     size_type len_;
 };
 
+// long lines with one or two separators are scanned by the delimiter mask kernel
 template<typename ContainerT>
 void split(const std::string &str, const std::string &sep, ContainerT &vec)
 {
     auto dat = str.data();
+    auto n = str.size();
+
+    if (n >= 64 && (sep.size() == 1 || sep.size() == 2)) {
+        static thread_local std::vector<std::uint64_t> mask;
+        mask.resize((n + 63) / 64);
+        kernel().delim_mask(dat, n, sep[0], sep.back(), mask.data());
+
+        std::size_t i = 0;
+        for (std::size_t w = 0; w < mask.size(); ++w) {
+            for (auto m = mask[w]; m != 0; m &= m - 1) {
+                auto j = w * 64 + lowest_bit(m);
+                if (j > i)
+                    vec.emplace_back(dat + i, j - i);
+                i = j + 1;
+            }
+        }
+
+        if (i < n)
+            vec.emplace_back(dat + i, n - i);
+
+        return;
+    }
+
     auto i = str.find_first_not_of(sep);
     auto j = str.find_first_of(sep, i);
 
@@ -0,0 +1,790 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <numeric>
+#include "stream.h"
+#include "hmp.h"
+#include "ped.h"
+#include "log.h"
+#include "perf.h"
+#include "progress.h"
+#include "summary.h"
+
+
+using std::size_t;
+
+
+namespace {
+
+// bytes a tile is read at a time while PED tiles are merged
+const size_t min_tile_read = 64 << 10;
+
+const char *const vcf_entry_error[] = {
+    "", "invalid VCF entry", "ploidy doesn't match", "column count doesn't match"
+};
+
+// parse a data line of n samples into rec, the first one sets the ploidy; an index into
+// vcf_entry_error on error
+int decode_vcf_entry(const std::string &line, VcfEntry &e, size_t n, int &ploidy, Locus &rec)
+{
+    if (parse_vcf_entry(line, e) != 0)
+        return 1;
+
+    if (ploidy <= 0)
+        ploidy = e.ploidy;
+
+    if (e.ploidy != ploidy)
+        return 2;
+
+    if (e.gt.size() != static_cast<size_t>(e.ploidy) * n * allele_width(e.as.size()))
+        return 3;
+
+    rec.loc.swap(e.id);
+    rec.chr.swap(e.chr);
+    rec.pos = e.pos;
+    rec.allele.swap(e.as);
+    rec.dat.swap(e.gt);
+    rec.flag = e.flag;
+
+    return 0;
+}
+
+} // namespace
+
+
+VcfSource::VcfSource(const std::string &filename, Progress *progress, bool passthrough)
+    : ifs_(filename, progress), progress_(progress), passthrough_(passthrough)
+{
+    if ( ! ifs_ ) {
+        log_stream() << "ERROR: can't open file for reading: " << filename << "\n";
+        error_ = 1;
+        return;
+    }
+
+    while ( ifs_.getline(line_) ) {
+        if (line_.compare(0, 2, "##") == 0) {
+            if ( passthrough_ )
+                meta_.push_back(line_);
+            continue;
+        }
+
+        if (line_.compare(0, 1, "#") == 0) {
+            if (parse_vcf_header(line_, ind_) != 0) {
+                log_stream() << "ERROR: invalid VCF header at line " << ifs_.line_number() << "\n";
+                error_ = 1;
+            }
+            break;
+        }
+
+        log_stream() << "ERROR: VCF header line is required\n";
+        error_ = 1;
+        break;
+    }
+}
+
+bool VcfSource::next(Locus &rec)
+{
+    if ( error_ )
+        return false;
+
+    if ( ! ifs_.getline(line_) ) {
+        if (ifs_.error() || (progress_ && progress_->cancelled()))
+            error_ = 1;
+        return false;
+    }
+
+    if ( passthrough_ ) {
+        if (parse_vcf_site(line_, e_) != 0) {
+            log_stream() << "ERROR: invalid VCF entry at line " << ifs_.line_number() << "\n";
+            error_ = 1;
+            return false;
+        }
+        rec.loc.swap(e_.id);
+        rec.chr.swap(e_.chr);
+        rec.pos = e_.pos;
+        rec.allele.swap(e_.as);
+        rec.dat.clear();
+        rec.flag = e_.flag;
+        rec.raw.swap(line_);
+        return true;
+    }
+
+    error_ = decode_vcf_entry(line_, e_, ind_.size(), ploidy_, rec);
+    if (error_ != 0) {
+        log_stream() << "ERROR: " << vcf_entry_error[error_] << " at line " << ifs_.line_number() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+VcfIndexSource::VcfIndexSource(const char *data, const VcfIndex &idx, Progress *progress)
+    : data_(data), idx_(idx), progress_(progress)
+{
+    ind_ = idx.ind;
+}
+
+bool VcfIndexSource::next(Locus &rec)
+{
+    if (error_ || k_ == idx_.line.size())
+        return false;
+
+    auto &e = idx_.line[k_++];
+
+    if (progress_ && ! progress_->add(e.length + 1, 1)) {
+        error_ = 1;
+        return false;
+    }
+
+    line_.assign(data_ + e.offset, e.length);
+
+    error_ = decode_vcf_entry(line_, e_, ind_.size(), ploidy_, rec);
+    if (error_ != 0) {
+        log_stream() << "ERROR: " << vcf_entry_error[error_] << ": " << idx_.chr[e.chr] << ":" << e.pos << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+HmpSource::HmpSource(const std::string &filename, Progress *progress)
+    : ifs_(filename, progress), progress_(progress)
+{
+    if ( ! ifs_ ) {
+        log_stream() << "ERROR: can't open file for reading: " << filename << "\n";
+        error_ = 1;
+        return;
+    }
+
+    if (ifs_.getline(line_) && parse_hmp_header(line_, ind_) != 0) {
+        log_stream() << "ERROR: invalid HapMap header at line " << ifs_.line_number() << "\n";
+        error_ = 1;
+    }
+
+    ploidy_ = 2;
+}
+
+bool HmpSource::next(Locus &rec)
+{
+    if ( error_ )
+        return false;
+
+    if ( ! ifs_.getline(line_) ) {
+        if (ifs_.error() || (progress_ && progress_->cancelled()))
+            error_ = 1;
+        return false;
+    }
+
+    HmpEntry e;
+
+    if (parse_hmp_entry(line_, e) != 0) {
+        log_stream() << "ERROR: invalid HapMap entry at line " << ifs_.line_number() << "\n";
+        error_ = 1;
+        return false;
+    }
+
+    if (e.gt.size() != 2 * ind_.size()) {
+        log_stream() << "ERROR: column count doesn't match at line " << ifs_.line_number() << ": " << e.id << "\n";
+        error_ = 1;
+        return false;
+    }
+
+    rec.loc.swap(e.id);
+    rec.chr.swap(e.chr);
+    rec.pos = e.pos;
+    rec.allele.swap(e.as);
+    rec.dat.swap(e.gt);
+    rec.flag = e.flag;
+
+    return true;
+}
+
+MemorySource::MemorySource(Genotype &&gt)
+    : gt_(std::move(gt))
+{
+    ind_ = gt_.ind;
+    meta_ = gt_.meta;
+    ploidy_ = gt_.ploidy;
+}
+
+bool MemorySource::next(Locus &rec)
+{
+    if (j_ >= gt_.loc.size())
+        return false;
+
+    rec.flag = locus_flags(gt_, j_);
+    rec.loc.swap(gt_.loc[j_]);
+    rec.chr.swap(gt_.chr[j_]);
+    rec.pos = gt_.pos[j_];
+    auto as = gt_.allele[j_];
+    rec.allele.assign(as.begin(), as.end());
+    if (rec.flag & LOCUS_SPARSE) {
+        expand_sparse(gt_.dat[j_], rec.allele.size(), rec.dat);
+        rec.flag &= ~LOCUS_SPARSE;
+        std::vector<allele_t>().swap(gt_.dat[j_]);
+    }
+    else
+        rec.dat.swap(gt_.dat[j_]);
+
+    if (j_ < gt_.raw.size())
+        rec.raw.swap(gt_.raw[j_]);
+    else
+        rec.raw.clear();
+
+    ++j_;
+
+    return true;
+}
+
+VcfSink::VcfSink(const std::string &filename, bool force_diploid)
+    : filename_(filename), force_diploid_(force_diploid)
+{
+}
+
+int VcfSink::begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta)
+{
+    ofs_.open(filename_);
+    if ( ! ofs_ ) {
+        log_stream() << "ERROR: can't open file for writing: " << filename_ << "\n";
+        return 1;
+    }
+
+    n_ = samples.size();
+    ofs_ << format_vcf_header(samples, meta);
+
+    return 0;
+}
+
+int VcfSink::write(const Locus &rec)
+{
+    if ( ! rec.raw.empty() ) {
+        ofs_ << rec.raw << "\n";
+        return ofs_ ? 0 : 1;
+    }
+
+    line_.clear();
+    format_vcf_entry(rec.chr, rec.pos, rec.loc, rec.allele, rec.dat, n_, force_diploid_, line_);
+    line_.push_back('\n');
+
+    ofs_ << line_;
+
+    return ofs_ ? 0 : 1;
+}
+
+int VcfSink::end()
+{
+    ofs_.close();
+    return ofs_ ? 0 : 1;
+}
+
+HmpSink::HmpSink(const std::string &filename)
+    : filename_(filename)
+{
+}
+
+int HmpSink::begin(const std::vector<std::string> &samples, const std::vector<std::string> &)
+{
+    ofs_.open(filename_);
+    if ( ! ofs_ ) {
+        log_stream() << "ERROR: can't open file for writing: " << filename_ << "\n";
+        return 1;
+    }
+
+    n_ = samples.size();
+    ofs_ << format_hmp_header(samples);
+
+    return 0;
+}
+
+int HmpSink::write(const Locus &rec)
+{
+    if ( ! rec.raw.empty() ) {
+        log_stream() << "ERROR: VCF passthrough data can only be written to VCF\n";
+        return 1;
+    }
+
+    line_.clear();
+
+    int info = check_compat_hmp(rec.flag);
+    if (info == 0)
+        info = format_hmp_entry(rec.loc, rec.chr, rec.pos, rec.allele, rec.dat, n_, line_);
+    if (info != 0) {
+        log_stream() << "ERROR: genotype data is not compatible with HapMap format: " << info << ", " << rec.loc << "\n";
+        return 1;
+    }
+
+    line_.push_back('\n');
+
+    ofs_ << line_;
+
+    return ofs_ ? 0 : 1;
+}
+
+int HmpSink::end()
+{
+    ofs_.close();
+    return ofs_ ? 0 : 1;
+}
+
+PedSink::PedSink(const std::string &filename, size_t memory)
+    : filename_(filename), memory_(memory)
+{
+}
+
+PedSink::~PedSink()
+{
+    remove_tmp();
+}
+
+void PedSink::remove_tmp()
+{
+    tmp_.close();
+    if ( ! tmp_name_.empty() ) {
+        std::remove(tmp_name_.c_str());
+        tmp_name_.clear();
+    }
+}
+
+int PedSink::begin(const std::vector<std::string> &samples, const std::vector<std::string> &)
+{
+    if (memory_ < 2 * min_tile_read) {
+        log_stream() << "ERROR: memory limit for PED output must be at least " << (2 * min_tile_read >> 10)
+                     << "K to merge its tiles\n";
+        return 1;
+    }
+
+    map_.open(filename_ + ".map");
+    if ( ! map_ ) {
+        log_stream() << "ERROR: can't open file for writing: " << filename_ << ".map\n";
+        return 1;
+    }
+
+    std::vector<std::string> fid, iid;
+    parse_fid_iid(samples, fid, iid);
+
+    n_ = samples.size();
+    ids_.clear();
+    for (size_t i = 0; i < n_; ++i)
+        ids_.push_back(fid[i] + " " + iid[i] + " 0 0 1 0");
+
+    // 4 bytes per sample and locus
+    cap_ = std::max<size_t>(1, memory_ / std::max<size_t>(1, n_ * 4));
+
+    return 0;
+}
+
+int PedSink::write(const Locus &rec)
+{
+    if ( ! rec.raw.empty() ) {
+        log_stream() << "ERROR: VCF passthrough data can only be written to VCF\n";
+        return 1;
+    }
+
+    // one byte allele codes, checked by the flags
+    auto p = n_ == 0 ? 0 : rec.dat.size() / n_;
+
+    int info = 0;
+    if ( ! (rec.flag & LOCUS_BIALLELIC) )
+        info = 1;
+    else if ( ! (rec.flag & LOCUS_ACGT) )
+        info = 2;
+    else if (p > 2)
+        info = 3;
+
+    if (info != 0) {
+        log_stream() << "ERROR: genotype data is not compatible with PED format: " << info << ", " << rec.loc << "\n";
+        return 1;
+    }
+
+    char codes[3] = { '0', 0, 0 };
+    for (size_t k = 0; k < rec.allele.size(); ++k)
+        codes[k+1] = rec.allele[k][0];
+
+    auto k = tile_.size();
+    tile_.resize(k + n_ * 4);
+    auto q = &tile_[k];
+
+    for (size_t i = 0; i < n_; ++i, q += 4) {
+        auto a = p == 2 ? rec.dat[i*2] : rec.dat[i];
+        auto b = p == 2 ? rec.dat[i*2+1] : rec.dat[i];
+        bool called = a && b;
+        q[0] = ' ';
+        q[1] = called ? codes[a] : '0';
+        q[2] = ' ';
+        q[3] = called ? codes[b] : '0';
+    }
+
+    map_ << rec.chr << " " << rec.loc << " 0 " << rec.pos << "\n";
+
+    if (++loci_ == cap_)
+        return flush_tile();
+
+    return map_ ? 0 : 1;
+}
+
+// samples in order, 16 at a time so that the loci of the tile are read a cache line at a time
+void PedSink::write_tile(std::ostream &out, bool lines)
+{
+    const size_t block = 16;
+    auto w = loci_ * 4;
+
+    for (size_t i0 = 0; i0 < n_; i0 += block) {
+        auto nb = std::min(block, n_ - i0);
+        chunk_.resize(nb * w);
+
+        for (size_t j = 0; j < loci_; ++j) {
+            auto s = &tile_[j * n_ * 4 + i0 * 4];
+            for (size_t i = 0; i < nb; ++i)
+                std::memcpy(&chunk_[i * w + j * 4], s + i * 4, 4);
+        }
+
+        for (size_t i = 0; i < nb; ++i) {
+            if ( lines )
+                out << ids_[i0+i];
+            out.write(&chunk_[i * w], static_cast<std::streamsize>(w));
+            if ( lines )
+                out << "\n";
+        }
+    }
+}
+
+int PedSink::flush_tile()
+{
+    if ( tmp_name_.empty() ) {
+        tmp_name_ = make_temp_file(filename_ + ".ped");
+        if ( tmp_name_.empty() ) {
+            log_stream() << "ERROR: can't create temporary file for: " << filename_ << ".ped\n";
+            return 1;
+        }
+        tmp_.open(tmp_name_, std::ios::binary);
+        if ( ! tmp_ ) {
+            log_stream() << "ERROR: can't open file for writing: " << tmp_name_ << "\n";
+            remove_tmp();
+            return 1;
+        }
+    }
+
+    write_tile(tmp_, false);
+    tiles_.push_back(loci_);
+    tile_.clear();
+    loci_ = 0;
+
+    if ( ! tmp_ ) {
+        log_stream() << "ERROR: failed to write file: " << tmp_name_ << "\n";
+        remove_tmp();
+        return 1;
+    }
+
+    return map_ ? 0 : 1;
+}
+
+// the chunk of a sample in a tile follows that of the previous sample, so each tile of
+// the group [k0, k1) is read sequentially through its own buffer
+int PedSink::merge_group(std::istream &in, const std::vector<std::uint64_t> &offset, size_t k0, size_t k1,
+                         std::ostream &out, bool lines)
+{
+    auto t = k1 - k0;
+    auto share = memory_ / t;
+    std::vector<std::uint64_t> next(offset.begin() + k0, offset.begin() + k1);
+    std::vector<std::string> buf(t);
+    std::vector<size_t> pos(t);
+
+    for (size_t i = 0; i < n_; ++i) {
+        if ( lines )
+            out << ids_[i];
+
+        for (size_t k = 0; k < t; ++k) {
+            for (auto w = tiles_[k0+k] * 4; w > 0; ) {
+                if (pos[k] == buf[k].size()) {
+                    auto m = static_cast<size_t>(std::min<std::uint64_t>(share, offset[k0+k+1] - next[k]));
+                    buf[k].resize(m);
+                    in.seekg(static_cast<std::streamoff>(next[k]));
+                    in.read(&buf[k][0], static_cast<std::streamsize>(m));
+                    if ( ! in ) {
+                        log_stream() << "ERROR: failed to read file: " << tmp_name_ << "\n";
+                        return 1;
+                    }
+                    next[k] += m;
+                    pos[k] = 0;
+                }
+
+                auto c = std::min(w, buf[k].size() - pos[k]);
+                out.write(&buf[k][pos[k]], static_cast<std::streamsize>(c));
+                pos[k] += c;
+                w -= c;
+            }
+        }
+
+        if ( lines )
+            out << "\n";
+    }
+
+    return 0;
+}
+
+// at most memory / min_tile_read tiles are merged at a time; more are first merged in
+// groups into wider tiles of another temporary file
+int PedSink::merge_tiles(std::ostream &out)
+{
+    auto fan_in = memory_ / min_tile_read;
+
+    for (;;) {
+        std::ifstream ifs(tmp_name_, std::ios::binary);
+        if ( ! ifs ) {
+            log_stream() << "ERROR: can't open file for reading: " << tmp_name_ << "\n";
+            return 1;
+        }
+
+        auto t = tiles_.size();
+        std::vector<std::uint64_t> offset(t + 1, 0);
+        for (size_t k = 0; k < t; ++k)
+            offset[k+1] = offset[k] + static_cast<std::uint64_t>(tiles_[k]) * 4 * n_;
+
+        if (t <= fan_in)
+            return merge_group(ifs, offset, 0, t, out, true);
+
+        auto name = make_temp_file(filename_ + ".ped");
+        if ( name.empty() ) {
+            log_stream() << "ERROR: can't create temporary file for: " << filename_ << ".ped\n";
+            return 1;
+        }
+
+        std::ofstream ofs(name, std::ios::binary);
+        std::vector<size_t> tiles;
+        int info = 0;
+
+        for (size_t k0 = 0; k0 < t && info == 0; k0 += fan_in) {
+            auto k1 = std::min(t, k0 + fan_in);
+            info = merge_group(ifs, offset, k0, k1, ofs, false);
+            tiles.push_back(std::accumulate(tiles_.begin() + k0, tiles_.begin() + k1, size_t(0)));
+        }
+
+        ofs.close();
+        if (info == 0 && ! ofs) {
+            log_stream() << "ERROR: failed to write file: " << name << "\n";
+            info = 1;
+        }
+
+        if (info != 0) {
+            std::remove(name.c_str());
+            return 1;
+        }
+
+        ifs.close();
+        remove_tmp();
+        tmp_name_ = name;
+        tiles_.swap(tiles);
+    }
+}
+
+int PedSink::end()
+{
+    int info = 0;
+
+    if ( ! tiles_.empty() && loci_ > 0 )
+        info = flush_tile();
+
+    if (info != 0)
+        return 1;
+
+    LineWriter ofs(filename_ + ".ped");
+    if ( ! ofs ) {
+        log_stream() << "ERROR: can't open file for writing: " << filename_ << ".ped\n";
+        return 1;
+    }
+
+    if ( tiles_.empty() )
+        write_tile(ofs, true);
+    else {
+        tmp_.close();
+        if ( ! tmp_ ) {
+            log_stream() << "ERROR: failed to write file: " << tmp_name_ << "\n";
+            remove_tmp();
+            return 1;
+        }
+        info = merge_tiles(ofs);
+        remove_tmp();
+    }
+
+    ofs.close();
+    map_.close();
+    if ( ! ofs || ! map_ ) {
+        log_stream() << "ERROR: failed to write file: " << filename_ << ".ped/.map\n";
+        return 1;
+    }
+
+    return info;
+}
+
+BufferedSink::BufferedSink(Writer writer)
+    : writer_(std::move(writer))
+{
+}
+
+int BufferedSink::begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta)
+{
+    gt_ = Genotype();
+    gt_.ind = samples;
+    gt_.meta = meta;
+    return 0;
+}
+
+int BufferedSink::write(const Locus &rec)
+{
+    if (gt_.ploidy <= 0 && ! gt_.ind.empty())
+        gt_.ploidy = static_cast<int>(rec.dat.size() / gt_.ind.size() / allele_width(rec.allele.size()));
+
+    Locus tmp = rec;
+    append_locus(gt_, tmp);
+
+    return 0;
+}
+
+int BufferedSink::end()
+{
+    int info = writer_(gt_);
+    gt_ = Genotype();
+    return info;
+}
+
+ChrSplitSink::ChrSplitSink(Opener opener, bool overlap)
+    : opener_(std::move(opener)), overlap_(overlap)
+{
+}
+
+ChrSplitSink::~ChrSplitSink()
+{
+    wait();
+}
+
+int ChrSplitSink::wait()
+{
+    if ( ! thread_.joinable() )
+        return 0;
+
+    thread_.join();
+    done_.reset();
+
+    return ended_;
+}
+
+int ChrSplitSink::begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta)
+{
+    ind_ = samples;
+    meta_ = meta;
+    chr_.clear();
+    seen_.clear();
+    wait();
+    sink_.reset();
+    return 0;
+}
+
+int ChrSplitSink::write(const Locus &rec)
+{
+    if ( ! sink_ || rec.chr != chr_.back() ) {
+        if ( ! seen_.insert(rec.chr).second ) {
+            log_stream() << "ERROR: loci are not grouped by chromosome, " << rec.chr << " reappears: " << rec.loc << "\n";
+            return 1;
+        }
+        if (wait() != 0)
+            return 1;
+        if ( sink_ && ! overlap_ ) {
+            if (sink_->end() != 0)
+                return 1;
+            sink_.reset();
+        }
+        if ( sink_ ) {
+            // the thread logs where the calling thread does
+            done_ = std::move(sink_);
+            auto log = log_handler();
+            thread_ = std::thread([this, log]() {
+                LogScope scope(log);
+                ended_ = done_->end();
+            });
+        }
+        chr_.push_back(rec.chr);
+        sink_ = opener_(rec.chr);
+        if ( ! sink_ || sink_->begin(ind_, meta_) != 0 )
+            return 1;
+    }
+
+    return sink_->write(rec);
+}
+
+int ChrSplitSink::end()
+{
+    int info = wait();
+    if ( sink_ ) {
+        info = sink_->end() != 0 ? 1 : info;
+        sink_.reset();
+    }
+    return info;
+}
+
+int MemorySink::begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta)
+{
+    gt_.ind = samples;
+    gt_.meta = meta;
+    return 0;
+}
+
+int MemorySink::write(const Locus &rec)
+{
+    if (gt_.ploidy <= 0 && ! gt_.ind.empty())
+        gt_.ploidy = static_cast<int>(rec.dat.size() / gt_.ind.size() / allele_width(rec.allele.size()));
+
+    Locus tmp = rec;
+    append_locus(gt_, tmp);
+
+    return 0;
+}
+
+void append_locus(Genotype &gt, Locus &rec)
+{
+    gt.loc.push_back(std::move(rec.loc));
+    gt.chr.push_back(std::move(rec.chr));
+    gt.pos.push_back(rec.pos);
+    gt.allele.push_back(std::move(rec.allele));
+    gt.dat.push_back(std::move(rec.dat));
+
+    // loci of a genotype have flags recorded for all or none, only then can they be sparse
+    if (gt.flag.size() + 1 == gt.loc.size()) {
+        gt.flag.push_back(rec.flag);
+        if (make_sparse(gt.dat.back(), gt.allele.back().size()))
+            gt.flag.back() |= LOCUS_SPARSE;
+    }
+
+    if ( ! rec.raw.empty() )
+        gt.raw.push_back(std::move(rec.raw));
+}
+
+int pump(GenotypeSource &src, GenotypeSink &sink, std::uint64_t *count, GenotypeSummary *summary)
+{
+    if ( count )
+        *count = 0;
+
+    if ( src.error() )
+        return 1;
+
+    if (sink.begin(src.samples(), src.meta()) != 0)
+        return 1;
+
+    if ( summary )
+        summary->begin(src.samples());
+
+    for (Locus rec; src.next(rec); ) {
+        if (summary && ! summary->add(rec.loc, rec.chr, rec.pos, rec.allele, rec.dat))
+            continue;
+        if (sink.write(rec) != 0)
+            return 1;
+        if ( count )
+            ++*count;
+    }
+
+    if ( src.error() )
+        return 1;
+
+    return sink.end();
+}
@@ -0,0 +1,331 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <unordered_set>
+#include "vcf.h"
+#include "lineio.h"
+
+
+// Record oriented access to genotype data
+//
+//   A GenotypeSource yields one locus at a time (pull), a GenotypeSink consumes one
+//   locus at a time (push). Records flow in memory, no temporary file is needed:
+//
+//     VcfSource src("in.vcf");
+//     HmpSink sink("out.hmp");
+//     if (pump(src, sink) != 0)
+//         ...
+//
+//   VCF and HapMap are streamed line by line. PED is sample-major and the general
+//   genotype format is coded from all loci, so these are loaded or written as a
+//   whole by MemorySource and BufferedSink; PedSink writes PED within a memory budget.
+//
+
+
+struct Locus
+{
+    std::string loc;
+    std::string chr;
+    std::vector<std::string> allele;
+    std::vector<allele_t> dat;
+    pos_t pos = 0;
+
+    // LocusFlag bits, set by every source
+    std::uint8_t flag = 0;
+
+    // VCF passthrough data line, dat is empty then
+    std::string raw;
+};
+
+
+class GenotypeSource
+{
+public:
+    virtual ~GenotypeSource() {}
+
+    // read the next locus, false at the end of input or on error
+    virtual bool next(Locus &rec) = 0;
+
+    const std::vector<std::string>& samples() const { return ind_; }
+
+    // ## header lines of VCF passthrough input, empty otherwise
+    const std::vector<std::string>& meta() const { return meta_; }
+
+    // 0 until the first locus is read if the input doesn't declare it
+    int ploidy() const { return ploidy_; }
+
+    // non-zero if the input can't be opened or is invalid
+    int error() const { return error_; }
+
+protected:
+    std::vector<std::string> ind_;
+    std::vector<std::string> meta_;
+    int ploidy_ = 0;
+    int error_ = 0;
+};
+
+
+class GenotypeSink
+{
+public:
+    virtual ~GenotypeSink() {}
+
+    // write the header, must be called once before any locus; meta is the header of
+    // VCF passthrough input, see GenotypeSource::meta
+    virtual int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta) = 0;
+
+    // ploidy of a locus is its number of alleles divided by the number of samples,
+    // loci of VCF passthrough input can only be written by VcfSink
+    virtual int write(const Locus &rec) = 0;
+
+    // flush buffered data
+    virtual int end() { return 0; }
+};
+
+
+class VcfSource : public GenotypeSource
+{
+public:
+    // passthrough keeps ## header lines and each data line as read, see Locus::raw
+    explicit VcfSource(const std::string &filename, Progress *progress = nullptr, bool passthrough = false);
+
+    bool next(Locus &rec);
+
+private:
+    LineReader ifs_;
+    Progress *progress_;
+    VcfEntry e_;
+    std::string line_;
+    bool passthrough_;
+};
+
+
+// data lines of a mapped VCF file in the order of its index, e.g. sorted by
+// sort_vcf_index; the data and the index must outlive the source
+class VcfIndexSource : public GenotypeSource
+{
+public:
+    VcfIndexSource(const char *data, const VcfIndex &idx, Progress *progress = nullptr);
+
+    bool next(Locus &rec);
+
+private:
+    const char *data_;
+    const VcfIndex &idx_;
+    std::size_t k_ = 0;
+    Progress *progress_;
+    VcfEntry e_;
+    std::string line_;
+};
+
+
+class HmpSource : public GenotypeSource
+{
+public:
+    explicit HmpSource(const std::string &filename, Progress *progress = nullptr);
+
+    bool next(Locus &rec);
+
+private:
+    LineReader ifs_;
+    Progress *progress_;
+    std::string line_;
+};
+
+
+// loci of a loaded genotype, which are moved out one by one
+class MemorySource : public GenotypeSource
+{
+public:
+    explicit MemorySource(Genotype &&gt);
+
+    bool next(Locus &rec);
+
+private:
+    Genotype gt_;
+    std::size_t j_ = 0;
+};
+
+
+class VcfSink : public GenotypeSink
+{
+public:
+    explicit VcfSink(const std::string &filename, bool force_diploid = true);
+
+    int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta);
+
+    int write(const Locus &rec);
+
+    int end();
+
+private:
+    std::string filename_;
+    LineWriter ofs_;
+    std::string line_;
+    std::size_t n_ = 0;
+    bool force_diploid_;
+};
+
+
+class HmpSink : public GenotypeSink
+{
+public:
+    explicit HmpSink(const std::string &filename);
+
+    int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta);
+
+    int write(const Locus &rec);
+
+    int end();
+
+private:
+    std::string filename_;
+    LineWriter ofs_;
+    std::string line_;
+    std::size_t n_ = 0;
+};
+
+
+// writes PED and MAP files of the prefix filename within a memory budget: the PED text
+// of the loci is collected in a tile of all samples, which goes to a temporary file of a
+// unique name (filename.ped.XXXXXX) in sample-major order whenever it reaches the budget;
+// at the end the tiles are merged into the PED lines, each tile read through its share of
+// the budget, in several passes if there are more tiles than shares of 64 KB. The budget
+// must be at least 128 KB. The temporary file is removed at the end or on error.
+// Nothing is written to the temporary file if all loci fit into one tile.
+class PedSink : public GenotypeSink
+{
+public:
+    PedSink(const std::string &filename, std::size_t memory);
+
+    ~PedSink();
+
+    int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta);
+
+    int write(const Locus &rec);
+
+    int end();
+
+private:
+    int flush_tile();
+
+    void write_tile(std::ostream &out, bool lines);
+
+    int merge_group(std::istream &in, const std::vector<std::uint64_t> &offset, std::size_t k0, std::size_t k1,
+                    std::ostream &out, bool lines);
+
+    int merge_tiles(std::ostream &out);
+
+    void remove_tmp();
+
+private:
+    std::string filename_;
+    std::size_t memory_;
+    LineWriter map_;
+    std::vector<std::string> ids_;
+    std::size_t n_ = 0;
+
+    // " a b" of each sample per locus, locus-major
+    std::string tile_;
+    std::string chunk_;
+    std::size_t cap_ = 1;
+    std::size_t loci_ = 0;
+
+    // spilled tiles, in a file of a unique name next to the output
+    std::string tmp_name_;
+    std::ofstream tmp_;
+    std::vector<std::size_t> tiles_;
+};
+
+
+// collects loci and writes them with a whole-genotype writer at the end
+class BufferedSink : public GenotypeSink
+{
+public:
+    using Writer = std::function<int(const Genotype &)>;
+
+    explicit BufferedSink(Writer writer);
+
+    int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta);
+
+    int write(const Locus &rec);
+
+    int end();
+
+private:
+    Writer writer_;
+    Genotype gt_;
+};
+
+
+// writes the loci of each chromosome to a sink of its own, which is opened when the first
+// locus of the chromosome arrives and ended by a thread of its own when the next chromosome
+// begins if overlap is set, so that e.g. a buffered chromosome is written while the next
+// one is read; loci must be grouped by chromosome, see chr_grouped, a chromosome that
+// reappears is an error
+class ChrSplitSink : public GenotypeSink
+{
+public:
+    using Opener = std::function<std::unique_ptr<GenotypeSink>(const std::string &chr)>;
+
+    explicit ChrSplitSink(Opener opener, bool overlap = true);
+
+    ~ChrSplitSink();
+
+    int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta);
+
+    int write(const Locus &rec);
+
+    int end();
+
+    // chromosomes in input order
+    const std::vector<std::string>& chromosomes() const { return chr_; }
+
+private:
+    Opener opener_;
+    bool overlap_;
+    std::vector<std::string> ind_;
+    std::vector<std::string> meta_;
+    std::vector<std::string> chr_;
+    std::unordered_set<std::string> seen_;
+    std::unique_ptr<GenotypeSink> sink_;
+
+    // sink of the previous chromosome, ended by thread_ with the result ended_
+    int wait();
+
+    std::unique_ptr<GenotypeSink> done_;
+    std::thread thread_;
+    int ended_ = 0;
+};
+
+
+// appends loci to a genotype in memory
+class MemorySink : public GenotypeSink
+{
+public:
+    explicit MemorySink(Genotype &gt) : gt_(gt) {}
+
+    int begin(const std::vector<std::string> &samples, const std::vector<std::string> &meta);
+
+    int write(const Locus &rec);
+
+private:
+    Genotype &gt_;
+};
+
+
+// move a locus to the end of a genotype
+void append_locus(Genotype &gt, Locus &rec);
+
+// pass all loci of a source to a sink, count is set to the number of loci passed; loci are
+// counted into the summary on the way if one is given
+int pump(GenotypeSource &src, GenotypeSink &sink, std::uint64_t *count = nullptr, GenotypeSummary *summary = nullptr);
+
+
+#endif // STREAM_H
@@ -0,0 +1,299 @@
+#include <limits>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include "summary.h"
+#include "kernel.h"
+#include "log.h"
+
+
+using std::size_t;
+
+
+namespace {
+
+const size_t flush_size = 1 << 20;
+
+void append_number(double x, std::string &s)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", x);
+    s.append(buf);
+}
+
+void append_rate(std::uint64_t a, std::uint64_t b, std::string &s)
+{
+    if (b == 0)
+        s.append("NA");
+    else
+        append_number(static_cast<double>(a) / b, s);
+}
+
+} // namespace
+
+
+void count_locus(const std::vector<std::string> &as, const std::vector<allele_t> &dat, size_t n,
+                 LocusCounts &c, std::uint32_t *miss)
+{
+    auto na = as.size();
+    auto w = allele_width(na);
+
+    c.allele.assign(na + 1, 0);
+    c.missing = 0;
+    c.het = 0;
+    c.n = n;
+
+    if (n == 0 || dat.empty())
+        return;
+
+    auto &k = kernel();
+    auto p = dat.size() / w / n;
+
+    // allele codes are at most na
+    if (w == 1 && na <= 3) {
+        std::uint64_t count[4] = { 0, 0, 0, 0 };
+        k.count_codes(dat.data(), dat.size(), count);
+        std::copy(count, count + na + 1, c.allele.begin());
+    }
+    else {
+        auto m = dat.size() / w;
+        for (size_t i = 0; i < m; ++i)
+            ++c.allele[get_allele(dat, i, w)];
+    }
+
+    if (w == 1 && p == 2) {
+        k.diploid_stats(dat.data(), n, &c.missing, &c.het, miss);
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        auto a = get_allele(dat, i*p, w);
+        bool missing = a == 0, het = false;
+
+        for (size_t j = 1; j < p; ++j) {
+            auto b = get_allele(dat, i*p+j, w);
+            missing = missing || b == 0;
+            het = het || b != a;
+        }
+
+        if ( missing ) {
+            ++c.missing;
+            if ( miss )
+                ++miss[i];
+        }
+        else if ( het )
+            ++c.het;
+    }
+}
+
+double minor_allele_freq(const LocusCounts &c)
+{
+    std::uint64_t called = 0, major = 0;
+
+    for (size_t k = 1; k < c.allele.size(); ++k) {
+        called += c.allele[k];
+        major = std::max(major, c.allele[k]);
+    }
+
+    if (called == 0)
+        return -1;
+
+    return static_cast<double>(called - major) / called;
+}
+
+bool LocusFilter::keep(const LocusCounts &c) const
+{
+    if (c.n > 0 && static_cast<double>(c.missing) / c.n > max_missing)
+        return false;
+
+    if (maf > 0 && minor_allele_freq(c) < maf)
+        return false;
+
+    if ( drop_monomorphic ) {
+        auto na = std::count_if(c.allele.begin() + 1, c.allele.end(), [](std::uint64_t x) { return x != 0; });
+        if (na < 2)
+            return false;
+    }
+
+    return true;
+}
+
+int GenotypeSummary::open(const std::string &locus_file, const std::string &sample_file)
+{
+    locus_file_ = locus_file;
+    sample_file_ = sample_file;
+    rows_ = ! locus_file.empty();
+    samples_ = ! sample_file.empty();
+
+    if ( rows_ ) {
+        ofs_.reset(new LineWriter(locus_file));
+        if ( ! *ofs_ ) {
+            log_stream() << "ERROR: can't open file for writing: " << locus_file << "\n";
+            return 1;
+        }
+        *ofs_ << "Locus\tChromosome\tPosition\tAlleles\tAlleleCounts\tAlleleFreqs\tMAF\tMissingRate\tHeterozygosity\n";
+    }
+
+    return 0;
+}
+
+GenotypeSummary GenotypeSummary::part() const
+{
+    GenotypeSummary z;
+    z.rows_ = rows_;
+    z.samples_ = samples_;
+    z.filter_ = filter_;
+    return z;
+}
+
+void GenotypeSummary::begin(const std::vector<std::string> &samples)
+{
+    ind_ = samples;
+    missing_.assign(samples_ ? ind_.size() : 0, 0);
+    miss_.assign(samples_ ? ind_.size() : 0, 0);
+    pending_ = 0;
+}
+
+bool GenotypeSummary::add(const std::string &loc, const std::string &chr, pos_t pos,
+                          const std::vector<std::string> &as, const std::vector<allele_t> &dat)
+{
+    auto n = ind_.size();
+
+    // samples are counted once the locus is known to be kept
+    bool filter = filter_.active();
+    count_locus(as, dat, n, c_, samples_ && ! filter ? miss_.data() : nullptr);
+
+    if (filter && ! filter_.keep(c_)) {
+        ++rejected_;
+        return false;
+    }
+
+    if (filter && samples_)
+        count_locus(as, dat, n, c_, miss_.data());
+
+    ++loci_;
+    if (++pending_ == std::numeric_limits<std::uint32_t>::max())
+        flush_missing();
+
+    if ( ! rows_ )
+        return true;
+
+    buf_.append(loc).append("\t").append(chr).append("\t").append(std::to_string(pos)).append("\t");
+
+    if ( as.empty() )
+        buf_.append(".\t.\t.");
+    else {
+        std::uint64_t called = 0;
+        for (size_t k = 1; k < c_.allele.size(); ++k)
+            called += c_.allele[k];
+
+        for (size_t k = 0; k < as.size(); ++k)
+            buf_.append(k == 0 ? "" : ",").append(as[k]);
+        buf_.push_back('\t');
+
+        for (size_t k = 1; k < c_.allele.size(); ++k)
+            buf_.append(k == 1 ? "" : ",").append(std::to_string(c_.allele[k]));
+        buf_.push_back('\t');
+
+        for (size_t k = 1; k < c_.allele.size(); ++k) {
+            if (k != 1)
+                buf_.push_back(',');
+            append_rate(c_.allele[k], called, buf_);
+        }
+    }
+
+    buf_.push_back('\t');
+
+    auto maf = minor_allele_freq(c_);
+    if (maf < 0)
+        buf_.append("NA");
+    else
+        append_number(maf, buf_);
+
+    buf_.push_back('\t');
+    append_rate(c_.missing, c_.n, buf_);
+    buf_.push_back('\t');
+    append_rate(c_.het, c_.n - c_.missing, buf_);
+    buf_.push_back('\n');
+
+    if (ofs_ && buf_.size() >= flush_size) {
+        *ofs_ << buf_;
+        buf_.clear();
+    }
+
+    return true;
+}
+
+void GenotypeSummary::append(GenotypeSummary &other)
+{
+    other.flush_missing();
+
+    for (size_t i = 0; i < missing_.size() && i < other.missing_.size(); ++i)
+        missing_[i] += other.missing_[i];
+
+    loci_ += other.loci_;
+    rejected_ += other.rejected_;
+    buf_.append(other.buf_);
+
+    other = part();
+
+    if (ofs_ && buf_.size() >= flush_size) {
+        *ofs_ << buf_;
+        buf_.clear();
+    }
+}
+
+void GenotypeSummary::flush_missing()
+{
+    for (size_t i = 0; i < miss_.size(); ++i) {
+        missing_[i] += miss_[i];
+        miss_[i] = 0;
+    }
+
+    pending_ = 0;
+}
+
+int GenotypeSummary::end()
+{
+    flush_missing();
+
+    if ( ofs_ ) {
+        *ofs_ << buf_;
+        buf_.clear();
+        ofs_->close();
+        bool ok = static_cast<bool>(*ofs_);
+        ofs_.reset();
+        if ( ! ok ) {
+            log_stream() << "ERROR: failed to write file: " << locus_file_ << "\n";
+            return 1;
+        }
+    }
+
+    if ( sample_file_.empty() )
+        return 0;
+
+    LineWriter ofs(sample_file_);
+    if ( ! ofs ) {
+        log_stream() << "ERROR: can't open file for writing: " << sample_file_ << "\n";
+        return 1;
+    }
+
+    ofs << "Sample\tMissing\tLoci\tMissingRate\n";
+
+    std::string line;
+    for (size_t i = 0; i < ind_.size(); ++i) {
+        line.assign(ind_[i]).append("\t").append(std::to_string(missing_[i])).append("\t").append(std::to_string(loci_));
+        line.push_back('\t');
+        append_rate(missing_[i], loci_, line);
+        line.push_back('\n');
+        ofs << line;
+    }
+
+    ofs.close();
+    if ( ! ofs ) {
+        log_stream() << "ERROR: failed to write file: " << sample_file_ << "\n";
+        return 1;
+    }
+
+    return 0;
+}
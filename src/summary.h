@@ -0,0 +1,111 @@
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "vcf.h"
+#include "lineio.h"
+
+
+// Allele frequencies, missing rate and heterozygosity of each locus, and missing rate of
+// each sample, counted by the readers as loci are parsed
+//
+//   GenotypeSummary sum;
+//   sum.open("loci.tsv", "samples.tsv");
+//   load_genotype(Format::vcf, { "in.vcf" }, gt, &progress, false, &sum);
+//   sum.end();
+//
+//   A genotype is missing if any of its alleles is. Heterozygosity is the fraction of
+//   called genotypes of different alleles. Locus rows are written in input order.
+//
+//   With a filter, loci that fail it are dropped by the readers right after parsing and
+//   never stored or written; the statistics only count the loci kept.
+//
+
+
+struct LocusCounts
+{
+    std::vector<std::uint64_t> allele;  // calls of each allele, [0] for missing
+    std::uint64_t missing = 0;          // genotypes with a missing allele
+    std::uint64_t het = 0;              // called genotypes of different alleles
+    std::uint64_t n = 0;                // genotypes
+};
+
+// count the genotypes of a locus of n samples, miss[i] is incremented if sample i is
+// missing and miss is not null
+void count_locus(const std::vector<std::string> &as, const std::vector<allele_t> &dat, std::size_t n,
+                 LocusCounts &c, std::uint32_t *miss = nullptr);
+
+// frequency of all but the most common allele, -1 if no allele is called
+double minor_allele_freq(const LocusCounts &c);
+
+
+struct LocusFilter
+{
+    double maf = 0;                 // minimum minor allele frequency
+    double max_missing = 1;         // maximum fraction of missing genotypes
+    bool drop_monomorphic = false;  // drop loci of fewer than two called alleles
+
+    bool active() const { return maf > 0 || max_missing < 1 || drop_monomorphic; }
+
+    bool keep(const LocusCounts &c) const;
+};
+
+
+class GenotypeSummary
+{
+public:
+    // write locus rows as loci are added and sample rows at the end, either name may be
+    // empty; without open() locus rows are kept in memory until appended to another summary,
+    // with both empty only the filter is applied
+    int open(const std::string &locus_file, const std::string &sample_file);
+
+    void set_filter(const LocusFilter &filter) { filter_ = filter; }
+
+    // summary of part of the loci, read on another thread, see append
+    GenotypeSummary part() const;
+
+    // samples of the loci, called by the readers before the first locus
+    void begin(const std::vector<std::string> &samples);
+
+    // false if the locus fails the filter, it is not counted then
+    bool add(const std::string &loc, const std::string &chr, pos_t pos, const std::vector<std::string> &as,
+             const std::vector<allele_t> &dat);
+
+    // number of loci that failed the filter
+    std::uint64_t rejected() const { return rejected_; }
+
+    // move in the loci of a part, which follow those added so far
+    void append(GenotypeSummary &other);
+
+    // write the sample file and close the files, non-zero on write error
+    int end();
+
+private:
+    void flush_missing();
+
+private:
+    std::unique_ptr<LineWriter> ofs_;
+    std::string locus_file_;
+    std::string sample_file_;
+    bool rows_ = true;
+    bool samples_ = true;
+    std::string buf_;
+    LocusFilter filter_;
+    std::uint64_t rejected_ = 0;
+
+    std::vector<std::string> ind_;
+    std::uint64_t loci_ = 0;
+    std::vector<std::uint64_t> missing_;
+    LocusCounts c_;
+
+    // kernel counters, added to missing_ before they can wrap
+    std::vector<std::uint32_t> miss_;
+    std::uint64_t pending_ = 0;
+};
+
+
+#endif // SUMMARY_H
@@ -1,8 +1,19 @@
-#include <fstream>
+#include <atomic>
+#include <thread>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
 #include <algorithm>
 #include "vcf.h"
+#include "kernel.h"
 #include "split.h"
+#include "number.h"
+#include "stream.h"
+#include "log.h"
+#include "progress.h"
+#include "summary.h"
+#include "util.h"
 
 
 using std::size_t;
@@ -10,9 +21,36 @@ using std::size_t;
 
 namespace {
 
+// copies sampled by make_sparse, smaller loci are kept dense
+const size_t sparse_sample = 64;
 
-// parse GT, return ploidy number (1 or 2), otherwise error
-int parse_vcf_gt(const char *s, size_t n, int &a, int &b)
+// at most a quarter of the sampled copies differ from the most common allele
+bool sparse_candidate(const std::vector<allele_t> &v, size_t m, size_t w)
+{
+    unsigned sample[sparse_sample];
+    auto step = m / sparse_sample;
+    for (size_t i = 0; i < sparse_sample; ++i)
+        sample[i] = get_allele(v, i * step, w);
+
+    // such an allele is the majority, found by a vote
+    unsigned major = sample[0];
+    size_t votes = 0;
+    for (auto a : sample) {
+        if (votes == 0)
+            major = a;
+        votes += a == major ? 1 : size_t(-1);
+    }
+
+    auto top = static_cast<size_t>(std::count(sample, sample + sparse_sample, major));
+
+    return (sparse_sample - top) * 4 <= sparse_sample;
+}
+
+
+// parse GT and append coded alleles of fewer than na alleles, W bytes each, return ploidy
+// number, otherwise error
+template<size_t W>
+int parse_vcf_gt(const char *s, size_t n, int na, std::vector<allele_t> &gt)
 {
     auto beg = s;
     auto end = std::find(s, s + n, ':');
@@ -21,73 +59,413 @@ int parse_vcf_gt(const char *s, size_t n, int &a, int &b)
     if (len == 0)
         return -1;
 
+    // haploid and diploid calls of single digit alleles
     if (len == 1) {
-        if (*beg == '.')
+        if (*beg == '.') {
+            push_allele(gt, 0, W);
             return 1;
-        a = *beg - '0';
-        return a < 0 || a > 9 ? -1 : 1;
+        }
+        int a = *beg - '0';
+        if (a < 0 || a > 9 || a >= na)
+            return -1;
+        push_allele(gt, a+1, W);
+        return 1;
     }
 
     if (len == 3 && (beg[1] == '/' || beg[1] == '|')) {
-        if (beg[0] != '.') {
-            a = beg[0] - '0';
-            if (a < 0 || a > 9)
-                return -1;
-        }
+        int a = beg[0] - '0', b = beg[2] - '0';
+        if (beg[0] == '.')
+            a = -1;
+        else if (a < 0 || a > 9 || a >= na)
+            return -1;
+        if (beg[2] == '.')
+            b = -1;
+        else if (b < 0 || b > 9 || b >= na)
+            return -1;
+        push_allele(gt, a+1, W);
+        push_allele(gt, b+1, W);
+        return 2;
+    }
+
+    // any ploidy, alleles separated by '/' or '|'
+    int ploidy = 0;
+
+    for (auto p = beg; ; ++p) {
+        auto q = std::find_if(p, end, [](char c) { return c == '/' || c == '|'; });
+        if (q == p)
+            return -1;
 
-        if (beg[2] != '.') {
-            b = beg[2] - '0';
-            if (b < 0 || b > 9)
+        if (q - p == 1 && *p == '.')
+            push_allele(gt, 0, W);
+        else {
+            int a = 0;
+            for (auto r = p; r != q; ++r) {
+                if (*r < '0' || *r > '9' || a > max_alleles)
+                    return -1;
+                a = a * 10 + (*r - '0');
+            }
+            if (a >= na)
                 return -1;
+            push_allele(gt, a+1, W);
         }
 
-        return 2;
+        ++ploidy;
+
+        if (q == end)
+            break;
+
+        p = q;
     }
 
-    if (std::count(beg, end, '/') + std::count(beg, end, '|') > 1) {
-        std::cerr << "ERROR: polyploidy genotype is not supported: " << std::string(beg,end) << "\n";
-        return -1;
+    return ploidy;
+}
+
+// CHROM, POS, ID, REF and ALT
+int parse_vcf_columns(const Token *v, VcfEntry &e)
+{
+    e.chr = v[0].to_string();
+
+    if ( ! parse_integer(v[1], e.pos) ) {
+        log_stream() << "ERROR: invalid position: " << v[1].to_string() << "\n";
+        return 1;
     }
 
-    size_t pos = 0;
-    while (pos < len && beg[pos] != '/' && beg[pos] != '|')
-        ++pos;
-    if (pos == 0 || pos == len - 1)
-        return -1;
+    if (v[2].size() == 1 && v[2][0] == '.')
+        e.id = v[0].to_string() + "_" + v[1].to_string();
+    else
+        e.id = v[2].to_string();
+
+    e.as.clear();
+    e.as.push_back(v[3].to_string());
+    split(v[4].to_string(), ",", e.as);
+
+    e.flag = allele_flags(e.as);
+
+    return 0;
+}
+
+template<size_t W>
+int parse_vcf_gts(const std::vector<Token> &v, VcfEntry &e)
+{
+    auto na = static_cast<int>(e.as.size());
+    bool het = false;
+
+    for (size_t i = 9; i < v.size(); ++i) {
+        auto k = e.gt.size() / W;
+        int info = parse_vcf_gt<W>(v[i].data(), v[i].size(), na, e.gt);
+
+        if (info < 1) {
+            log_stream() << "ERROR: invalid genotype data: " << e.chr << " " << e.pos << " "
+                << v[3].to_string() << " " << v[4].to_string() << " " << v[i].to_string() << "\n";
+            return 1;
+        }
+
+        if (i == 9)
+            e.ploidy = info;
+
+        if (info != e.ploidy) {
+            log_stream() << "ERROR: ploidy doesn't match: " << v[i].to_string() << "\n";
+            return 1;
+        }
 
-    if (pos == len) {
-        a = std::stoi(std::string(beg,end));
-        return a < 0 ? -1 : 1;
+        for (int t = 1; t < info && ! het; ++t)
+            het = get_allele(e.gt, k + t, W) != get_allele(e.gt, k, W);
     }
 
-    std::string gt(beg, beg + pos);
-    if (gt != ".") {
-        a = std::stoi(gt);
-        if (a < 0)
-            return -1;
+    if ( het )
+        e.flag |= LOCUS_HET;
+
+    return 0;
+}
+
+// genotype coding of a locus, ploidy is only used by VCF_POLYPLOID
+enum VcfCoding { VCF_HAPLOID, VCF_HAPLOID_AS_DIPLOID, VCF_DIPLOID, VCF_POLYPLOID };
+
+// fewer than 11 alleles, allele codes are single characters
+template<VcfCoding C>
+void append_vcf_chars(const allele_t *dat, size_t n, size_t ploidy, std::string &line)
+{
+    static const char codes[] = ".0123456789";
+
+    const size_t w = C == VCF_HAPLOID ? 2 : C == VCF_POLYPLOID ? ploidy * 2 : 4;
+
+    auto k = line.size();
+    line.resize(k + w * n);
+    auto p = &line[k];
+
+    for (size_t i = 0; i < n; ++i, p += w) {
+        p[0] = '\t';
+        if (C == VCF_HAPLOID)
+            p[1] = codes[dat[i]];
+        else if (C == VCF_HAPLOID_AS_DIPLOID) {
+            p[1] = p[3] = codes[dat[i]];
+            p[2] = '/';
+        }
+        else if (C == VCF_DIPLOID) {
+            p[1] = codes[dat[i*2]];
+            p[2] = '/';
+            p[3] = codes[dat[i*2+1]];
+        }
+        else {
+            for (size_t k = 0; k < ploidy; ++k) {
+                p[k*2] = '/';
+                p[k*2+1] = codes[dat[i*ploidy+k]];
+            }
+            p[0] = '\t';
+        }
     }
+}
 
-    gt.assign(beg + pos + 1, end);
-    if (gt != ".") {
-        b = std::stoi(gt);
-        if (b < 0)
-            return -1;
+template<VcfCoding C>
+void append_vcf_strings(const allele_t *dat, size_t n, size_t ploidy, const std::string *codes, std::string &line)
+{
+    for (size_t i = 0; i < n; ++i) {
+        line.push_back('\t');
+        if (C == VCF_HAPLOID)
+            line.append(codes[dat[i]]);
+        else if (C == VCF_HAPLOID_AS_DIPLOID)
+            line.append(codes[dat[i]]).append("/").append(codes[dat[i]]);
+        else if (C == VCF_DIPLOID)
+            line.append(codes[dat[i*2]]).append("/").append(codes[dat[i*2+1]]);
+        else {
+            line.append(codes[dat[i*ploidy]]);
+            for (size_t k = 1; k < ploidy; ++k)
+                line.append("/").append(codes[dat[i*ploidy+k]]);
+        }
     }
+}
 
-    return 2;
+// loci of 16-bit allele codes are rare, numbers are formatted as they come
+void append_vcf_wide(const std::vector<allele_t> &dat, size_t n, bool force_diploid, std::string &line)
+{
+    auto ploidy = dat.size() / n / 2;
+
+    for (size_t i = 0; i < n; ++i) {
+        line.push_back('\t');
+        for (size_t k = 0; k < ploidy; ++k) {
+            auto a = get_allele(dat, i*ploidy+k, 2);
+            auto code = a == 0 ? std::string(".") : std::to_string(a-1);
+            if (k != 0)
+                line.push_back('/');
+            line.append(code);
+            if (ploidy == 1 && force_diploid)
+                line.append("/").append(code);
+        }
+    }
 }
 
 
 } // namespace
 
 
+std::uint32_t AlleleTable::intern(const std::string &s)
+{
+    auto h = std::hash<std::string>()(s);
+
+    auto r = lookup_.equal_range(h);
+    for (auto it = r.first; it != r.second; ++it) {
+        if (str_[it->second] == s)
+            return it->second;
+    }
+
+    auto id = static_cast<std::uint32_t>(str_.size());
+    str_.push_back(s);
+    lookup_.emplace(h, id);
+
+    return id;
+}
+
+void AlleleTable::push_back(const AlleleList &as)
+{
+    for (auto &e : as)
+        id_.push_back(intern(e));
+    off_.push_back(id_.size());
+}
+
+void AlleleTable::append(const AlleleTable &other)
+{
+    std::vector<std::uint32_t> ids;
+    for (auto &e : other.str_)
+        ids.push_back(intern(e));
+
+    for (auto id : other.id_)
+        id_.push_back(ids[id]);
+
+    auto base = off_.back();
+    for (size_t j = 1; j < other.off_.size(); ++j)
+        off_.push_back(base + other.off_[j]);
+}
+
+AlleleTable AlleleTable::subset(const std::vector<size_t> &idx) const
+{
+    AlleleTable t;
+    t.str_ = str_;
+    t.lookup_ = lookup_;
+    t.off_.reserve(idx.size() + 1);
+    t.id_.reserve(id_.size());
+
+    for (auto j : idx) {
+        t.id_.insert(t.id_.end(), id_.begin() + off_[j], id_.begin() + off_[j+1]);
+        t.off_.push_back(t.id_.size());
+    }
+
+    return t;
+}
+
+std::uint8_t allele_flags(const AlleleList &as)
+{
+    std::uint8_t flag = LOCUS_ACGT | LOCUS_SEQUENCE;
+
+    if (as.size() <= 2)
+        flag |= LOCUS_BIALLELIC;
+
+    for (auto &e : as) {
+        bool seq = e.find_first_not_of("ACGT") == std::string::npos;
+        if ( ! seq || e.size() != 1 )
+            flag &= ~LOCUS_ACGT;
+        if ( ! seq && e != "-" )
+            flag &= ~LOCUS_SEQUENCE;
+        if (e == "-" || e.size() != as[0].size())
+            flag |= LOCUS_INDEL;
+    }
+
+    return flag;
+}
+
+std::uint8_t locus_flags(const Genotype &gt, size_t j)
+{
+    if (j < gt.flag.size())
+        return gt.flag[j];
+
+    auto flag = allele_flags(gt.allele[j]);
+
+    auto &v = gt.dat[j];
+    auto w = allele_width(gt.allele[j].size());
+    size_t p = std::max(gt.ploidy, 1);
+    auto n = v.size() / w / p;
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 1; k < p; ++k) {
+            if (get_allele(v, i*p+k, w) != get_allele(v, i*p, w))
+                return flag | LOCUS_HET;
+        }
+    }
+
+    return flag;
+}
+
+bool make_sparse(std::vector<allele_t> &v, size_t na)
+{
+    auto w = allele_width(na);
+    auto m = v.size() / w;
+
+    if (m < sparse_sample || m > std::numeric_limits<std::uint32_t>::max())
+        return false;
+
+    std::vector<std::uint64_t> count(std::max<size_t>(na + 1, 4), 0);
+    if (w == 1 && na <= 3)
+        kernel().count_codes(v.data(), v.size(), count.data());
+    else {
+        // the scalar count is skipped for common variants by a sample of copies
+        if ( ! sparse_candidate(v, m, w) )
+            return false;
+        for (size_t k = 0; k < m; ++k)
+            ++count[get_allele(v, k, w)];
+    }
+
+    auto fill = static_cast<unsigned>(std::max_element(count.begin(), count.end()) - count.begin());
+
+    auto size = sparse_header + w + (m - count[fill]) * (4 + w);
+    if (size >= v.size())
+        return false;
+
+    std::vector<allele_t> z;
+    z.reserve(size);
+
+    auto n = static_cast<std::uint32_t>(m);
+    auto p = reinterpret_cast<const allele_t*>(&n);
+    z.insert(z.end(), p, p + 4);
+    push_allele(z, fill, w);
+
+    auto push = [&z](size_t k, unsigned a, size_t w) {
+        auto i = static_cast<std::uint32_t>(k);
+        auto p = reinterpret_cast<const allele_t*>(&i);
+        z.insert(z.end(), p, p + 4);
+        push_allele(z, a, w);
+    };
+
+    if (w == 1) {
+        // copies of the fill allele are found 64 at a time
+        static thread_local std::vector<std::uint64_t> mask;
+        mask.resize((m + 63) / 64);
+        auto c = static_cast<char>(fill);
+        kernel().delim_mask(reinterpret_cast<const char*>(v.data()), m, c, c, mask.data());
+
+        for (size_t t = 0; t < mask.size(); ++t) {
+            auto x = ~mask[t];
+            if (t + 1 == mask.size() && m % 64 != 0)
+                x &= (std::uint64_t(1) << (m % 64)) - 1;
+            for (; x != 0; x &= x - 1) {
+                auto k = t * 64 + lowest_bit(x);
+                push(k, v[k], 1);
+            }
+        }
+    }
+    else {
+        for (size_t k = 0; k < m; ++k) {
+            auto a = get_allele(v, k, w);
+            if (a != fill)
+                push(k, a, w);
+        }
+    }
+
+    v.swap(z);
+
+    return true;
+}
+
+void expand_sparse(const std::vector<allele_t> &v, size_t na, std::vector<allele_t> &dat)
+{
+    auto w = allele_width(na);
+
+    std::uint32_t m;
+    std::memcpy(&m, v.data(), 4);
+
+    dat.resize(static_cast<size_t>(m) * w);
+
+    if (w == 1)
+        std::fill(dat.begin(), dat.end(), v[sparse_header]);
+    else {
+        for (size_t k = 0; k < dat.size(); k += 2) {
+            dat[k] = v[sparse_header];
+            dat[k+1] = v[sparse_header+1];
+        }
+    }
+
+    for (size_t pos = sparse_header + w; pos < v.size(); pos += 4 + w) {
+        std::uint32_t k;
+        std::memcpy(&k, &v[pos], 4);
+        std::memcpy(&dat[k*w], &v[pos+4], w);
+    }
+}
+
+const std::vector<allele_t>& locus_data(const Genotype &gt, size_t j, std::vector<allele_t> &buf)
+{
+    if (j >= gt.flag.size() || ! (gt.flag[j] & LOCUS_SPARSE))
+        return gt.dat[j];
+
+    expand_sparse(gt.dat[j], gt.allele[j].size(), buf);
+
+    return buf;
+}
+
 int parse_vcf_header(const std::string &s, std::vector<std::string> &v)
 {
     v.clear();
     split(s, "\t", v);
 
     if (v.size() != 8 && v.size() < 10) {
-        std::cerr << "ERROR: incorrect number of columns in VCF header line: " << v.size() << "\n";
+        log_stream() << "ERROR: incorrect number of columns in VCF header line: " << v.size() << "\n";
         return 1;
     }
 
@@ -95,14 +473,14 @@ int parse_vcf_header(const std::string &s, std::vector<std::string> &v)
 
     for (size_t i = 0; i < 8; ++i) {
         if (v[i] != z[i]) {
-            std::cerr << "ERROR: incorrect column name in header line:" << v[i] << "\n";
+            log_stream() << "ERROR: incorrect column name in header line:" << v[i] << "\n";
             return 1;
         }
     }
 
     if (v.size() > 9) {
         if (v[8] != "FORMAT") {
-            std::cerr << "ERROR: FORMAT is required at 9th field in VCF header line: " << v[8] << "\n";
+            log_stream() << "ERROR: FORMAT is required at 9th field in VCF header line: " << v[8] << "\n";
             return 1;
         }
         v.erase(v.begin(), v.begin() + 9);
@@ -121,199 +499,456 @@ int parse_vcf_entry(const std::string &s, VcfEntry &e)
     auto n = v.size();
 
     if (n != 8 && n < 10) {
-        std::cerr << "ERROR: incorrect number of columns at VCF entry line: " << n << "\n";
+        log_stream() << "ERROR: incorrect number of columns at VCF entry line: " << n << "\n";
         return 1;
     }
 
-    e.chr = v[0].to_string();
-    e.pos = std::stoi(v[1].to_string());
-
-    if (v[2].size() == 1 && v[2][0] == '.')
-        e.id = v[0].to_string() + "_" + v[1].to_string();
-    else
-        e.id = v[2].to_string();
-
-    e.as.clear();
-    e.as.push_back(v[3].to_string());
-    split(v[4].to_string(), ",", e.as);
+    if (parse_vcf_columns(v.data(), e) != 0)
+        return 1;
 
     if (n == 8)
         return 0;
 
     if (v[8].size() < 2 || v[8][0] != 'G' || v[8][1] != 'T') {
-        std::cerr << "ERROR: GT is required and must be the first sub-field of FORMAT: " << v[8].to_string() << "\n";
+        log_stream() << "ERROR: GT is required and must be the first sub-field of FORMAT: " << v[8].to_string() << "\n";
         return 1;
     }
 
-    auto na = static_cast<int>(e.as.size());
-    if (na > 255) {
-        std::cerr << "ERROR: exceed the maximum number of alleles (255): " << na << "\n";
+    if (e.as.size() > static_cast<size_t>(max_alleles)) {
+        log_stream() << "ERROR: exceed the maximum number of alleles (" << max_alleles << "): " << e.as.size() << "\n";
         return 1;
     }
 
     e.gt.clear();
 
-    for (size_t i = 9; i < n; ++i) {
-        int a = -9, b = -9;
-        int info = parse_vcf_gt(v[i].data(), v[i].size(), a, b);
-
-        if ((info != 1 && info != 2) || a >= na || b >= na) {
-            std::cerr << "ERROR: invalid genotype data: " << e.chr << " " << e.pos << " "
-                << v[3].to_string() << " " << v[4].to_string() << " " << v[i].to_string() << "\n";
-            return 1;
-        }
+    if (allele_width(e.as.size()) == 1)
+        return parse_vcf_gts<1>(v, e);
 
-        if (i == 9)
-            e.ploidy = info;
+    return parse_vcf_gts<2>(v, e);
+}
 
-        if (info != e.ploidy) {
-            std::cerr << "ERROR: ploidy doesn't match: " << v[i].to_string() << "\n";
+int parse_vcf_site(const std::string &s, VcfEntry &e)
+{
+    // QUAL, FILTER and INFO must follow, the rest of the line is not looked at
+    Token v[5];
+    size_t beg = 0;
+
+    for (size_t k = 0; k < 7; ++k) {
+        auto end = s.find('\t', beg);
+        if (end == std::string::npos) {
+            log_stream() << "ERROR: incorrect number of columns at VCF entry line: " << k + 1 << "\n";
             return 1;
         }
-
-        e.gt.push_back(a < 0 ? 0 : static_cast<allele_t>(a+1));
-        if (e.ploidy == 2)
-            e.gt.push_back(b < 0 ? 0 : static_cast<allele_t>(b+1));
+        if (k < 5)
+            v[k] = Token(s.data() + beg, end - beg);
+        beg = end + 1;
     }
 
+    if (parse_vcf_columns(v, e) != 0)
+        return 1;
+
+    e.gt.clear();
+    e.ploidy = 0;
+
     return 0;
 }
 
-int read_vcf(const std::string &filename, Genotype &gt)
+int read_vcf(const std::string &filename, Genotype &gt, Progress *progress, bool passthrough,
+             GenotypeSummary *summary)
 {
-    std::ifstream ifs(filename);
-    if ( ! ifs ) {
-        std::cerr << "ERROR: can't open file for reading: " << filename << "\n";
+    VcfSource src(filename, progress, passthrough);
+    if ( src.error() )
         return 1;
+
+    gt.ind = src.samples();
+    gt.meta = src.meta();
+
+    if ( summary )
+        summary->begin(gt.ind);
+
+    for (Locus rec; src.next(rec); ) {
+        if (summary && ! summary->add(rec.loc, rec.chr, rec.pos, rec.allele, rec.dat))
+            continue;
+        append_locus(gt, rec);
     }
 
-    size_t ln = 0;
+    if ( src.error() )
+        return 1;
 
-    for (std::string line; std::getline(ifs, line); ) {
-        ++ln;
+    if (gt.ploidy <= 0)
+        gt.ploidy = src.ploidy();
 
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
+    return 0;
+}
 
-        if (line.compare(0, 2, "##") == 0)
-            continue;
+int read_vcf(const std::vector<std::string> &filenames, Genotype &gt, Progress *progress, bool passthrough,
+             GenotypeSummary *summary)
+{
+    if (filenames.size() == 1)
+        return read_vcf(filenames[0], gt, progress, passthrough, summary);
 
-        if (line.compare(0, 1, "#") == 0) {
-            if (parse_vcf_header(line, gt.ind) != 0)
-                return 1;
-            break;
-        }
+    auto nf = filenames.size();
 
-        std::cerr << "ERROR: VCF header line is required\n";
+    if (std::count(filenames.begin(), filenames.end(), "-") > 0) {
+        log_stream() << "ERROR: stdin (-) can't be one of several VCF files\n";
         return 1;
     }
 
-    VcfEntry e;
+    // samples and ploidy are checked from the header and first data line of each
+    // file, before any file is parsed
+    std::vector<std::string> ind;
+    int ploidy = 0;
 
-    for (std::string line; std::getline(ifs, line);) {
-        ++ln;
+    for (size_t k = 0; k < nf; ++k) {
+        VcfSource src(filenames[k], nullptr, passthrough);
+        Locus rec;
+        if (src.error() || (! src.next(rec) && src.error()))
+            return 1;
+        if (k == 0)
+            ind = src.samples();
+        else if (src.samples() != ind) {
+            log_stream() << "ERROR: sample columns don't match: " << filenames[k] << " vs " << filenames[0] << "\n";
+            return 1;
+        }
+        if (ploidy > 0 && src.ploidy() > 0 && src.ploidy() != ploidy) {
+            log_stream() << "ERROR: ploidy doesn't match: " << filenames[k] << " vs " << filenames[0] << "\n";
+            return 1;
+        }
+        if (ploidy <= 0)
+            ploidy = src.ploidy();
+    }
+
+    std::vector<Genotype> part(nf);
+    std::vector<int> info(nf, 0);
+
+    // each file is counted into its own summary, appended in input order
+    std::vector<GenotypeSummary> sum;
+    for (size_t k = 0; summary && k < nf; ++k)
+        sum.push_back(summary->part());
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t k = next++; k < nf; k = next++)
+            info[k] = read_vcf(filenames[k], part[k], progress, passthrough, summary ? &sum[k] : nullptr);
+    };
 
-        if ( ! line.empty() && line.back() == '\r' )
-            line.pop_back();
+    size_t nt = std::thread::hardware_concurrency();
+    nt = std::max(size_t(1), std::min(nt, nf));
 
-        if (parse_vcf_entry(line, e) != 0)
+    // pool threads log where the calling thread does
+    auto log = log_handler();
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < nt; ++t) {
+        pool.emplace_back([&worker, log]() {
+            LogScope scope(log);
+            worker();
+        });
+    }
+    worker();
+    for (auto &t : pool)
+        t.join();
+
+    for (size_t k = 0; k < nf; ++k) {
+        if (info[k] != 0)
             return 1;
+    }
 
+    if ( summary ) {
+        summary->begin(part[0].ind);
+        for (auto &e : sum)
+            summary->append(e);
+    }
+
+    gt.ind.swap(part[0].ind);
+    gt.meta.swap(part[0].meta);
+
+    for (auto &p : part) {
         if (gt.ploidy <= 0)
-            gt.ploidy = e.ploidy;
+            gt.ploidy = p.ploidy;
+        std::move(p.loc.begin(), p.loc.end(), std::back_inserter(gt.loc));
+        std::move(p.chr.begin(), p.chr.end(), std::back_inserter(gt.chr));
+        gt.pos.insert(gt.pos.end(), p.pos.begin(), p.pos.end());
+        std::move(p.dat.begin(), p.dat.end(), std::back_inserter(gt.dat));
+        gt.allele.append(p.allele);
+        gt.flag.insert(gt.flag.end(), p.flag.begin(), p.flag.end());
+        std::move(p.raw.begin(), p.raw.end(), std::back_inserter(gt.raw));
+        p = Genotype();
+    }
 
-        if (e.ploidy != gt.ploidy) {
-            std::cerr << "ERROR: ploidy doesn't match at line " << ln << "\n";
-            return 1;
-        }
+    return 0;
+}
 
-        if (e.gt.size() != static_cast<size_t>(e.ploidy) * gt.ind.size()) {
-            std::cerr << "ERROR: column count doesn't match at line " << ln << "\n";
-            return 1;
+std::string format_vcf_header(const std::vector<std::string> &ind, const std::vector<std::string> &meta)
+{
+    std::string s;
+
+    if ( meta.empty() )
+        s = "##fileformat=VCFv4.2\n";
+
+    for (auto &e : meta)
+        s.append(e).append("\n");
+
+    s.append("#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO");
+
+    if ( ! ind.empty() ) {
+        s.append("\tFORMAT");
+        for (auto &e : ind)
+            s.append("\t").append(e);
+    }
+
+    s.push_back('\n');
+
+    return s;
+}
+
+void format_vcf_entry(const std::string &chr, pos_t pos, const std::string &id, const AlleleList &as,
+                      const std::vector<allele_t> &dat, size_t n, bool force_diploid, std::string &line)
+{
+    static const std::vector<std::string> codes = [] {
+        std::vector<std::string> v(256);
+        v[0] = ".";
+        for (size_t i = 1; i < 256; ++i)
+            v[i] = std::to_string(i-1);
+        return v;
+    }();
+
+    line.append(chr).append("\t").append(std::to_string(pos)).append("\t").append(id).append("\t");
+
+    if ( as.empty() )
+        line.append(".\t.");
+    else {
+        auto na = as.size();
+        line.append(as[0]).append("\t");
+        if (na == 1) {
+            line.append(".");
         }
+        else {
+            line.append(as[1]);
+            for (size_t k = 2; k < na; ++k)
+                line.append(",").append(as[k]);
+        }
+    }
+
+    line.append("\t.\t.\t.");
+
+    if (n == 0)
+        return;
+
+    line.append("\tGT");
+
+    if (allele_width(as.size()) != 1)
+        return append_vcf_wide(dat, n, force_diploid, line);
+
+    auto ploidy = dat.size() / n;
+
+    auto coding = VCF_POLYPLOID;
+    if (ploidy == 1)
+        coding = force_diploid ? VCF_HAPLOID_AS_DIPLOID : VCF_HAPLOID;
+    else if (ploidy == 2)
+        coding = VCF_DIPLOID;
 
-        gt.loc.push_back(e.id);
-        gt.chr.push_back(e.chr);
-        gt.pos.push_back(e.pos);
-        gt.allele.push_back(e.as);
-        gt.dat.push_back(e.gt);
+    if (as.size() <= 10) {
+        switch (coding) {
+        case VCF_HAPLOID:
+            return append_vcf_chars<VCF_HAPLOID>(dat.data(), n, 1, line);
+        case VCF_HAPLOID_AS_DIPLOID:
+            return append_vcf_chars<VCF_HAPLOID_AS_DIPLOID>(dat.data(), n, 1, line);
+        case VCF_DIPLOID:
+            return append_vcf_chars<VCF_DIPLOID>(dat.data(), n, 2, line);
+        default:
+            return append_vcf_chars<VCF_POLYPLOID>(dat.data(), n, ploidy, line);
+        }
     }
 
-    return 0;
+    switch (coding) {
+    case VCF_HAPLOID:
+        return append_vcf_strings<VCF_HAPLOID>(dat.data(), n, 1, codes.data(), line);
+    case VCF_HAPLOID_AS_DIPLOID:
+        return append_vcf_strings<VCF_HAPLOID_AS_DIPLOID>(dat.data(), n, 1, codes.data(), line);
+    case VCF_DIPLOID:
+        return append_vcf_strings<VCF_DIPLOID>(dat.data(), n, 2, codes.data(), line);
+    default:
+        return append_vcf_strings<VCF_POLYPLOID>(dat.data(), n, ploidy, codes.data(), line);
+    }
 }
 
-int write_vcf(const Genotype & gt, const std::string & filename, bool force_diploid)
+int write_vcf(const Genotype & gt, const std::string & filename, bool force_diploid, Progress *progress,
+              const std::vector<size_t> *loci)
 {
-    std::ofstream ofs(filename);
+    LineWriter ofs(filename);
     if ( ! ofs ) {
-        std::cerr << "ERROR: can't open file for writing: " << filename << "\n";
+        log_stream() << "ERROR: can't open file for writing: " << filename << "\n";
         return 1;
     }
 
-    std::vector<std::string> codes(256);
-    codes[0] = ".";
-    for (size_t i = 1; i < 256; ++i)
-        codes[i] = std::to_string(i-1);
+    ofs << format_vcf_header(gt.ind, gt.meta);
 
+    std::string line;
+    std::vector<allele_t> buf;
+    auto m = locus_count(gt, loci);
     auto n = gt.ind.size();
 
-    ofs << "##fileformat=VCFv4.2\n";
-    ofs << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO";
-    if ( ! gt.ind.empty() ) {
-        ofs << "\tFORMAT";
-        for (size_t i = 0; i < n; ++i)
-            ofs << "\t" << gt.ind[i];
+    for (size_t k = 0; k < m; ++k) {
+        if (progress && ! progress->add(0, 1))
+            return 1;
+
+        auto j = locus_index(loci, k);
+
+        if ( ! gt.raw.empty() ) {
+            ofs << gt.raw[j] << "\n";
+            continue;
+        }
+
+        line.clear();
+        format_vcf_entry(gt.chr[j], gt.pos[j], gt.loc[j], gt.allele[j], locus_data(gt, j, buf), n, force_diploid, line);
+        line.push_back('\n');
+
+        ofs << line;
     }
-    ofs << "\n";
 
-    std::string line;
-    auto m = gt.loc.size();
-    bool haploid = gt.ploidy != 2;
+    ofs.close();
+    if ( ! ofs ) {
+        log_stream() << "ERROR: failed to write file: " << filename << "\n";
+        return 1;
+    }
 
-    for (size_t j = 0; j < m; ++j) {
-        ofs << gt.chr[j] << "\t" << gt.pos[j] << "\t" << gt.loc[j] << "\t";
+    return 0;
+}
 
-        if ( gt.allele[j].empty() )
-            ofs << ".\t.";
-        else {
-            auto na = gt.allele[j].size();
-            ofs << gt.allele[j][0] << "\t";
-            if (na == 1) {
-                ofs << ".";
-            }
-            else {
-                ofs << gt.allele[j][1];
-                for (size_t k = 2; k < na; ++k)
-                    ofs << "," << gt.allele[j][k];
-            }
-        }
+int index_vcf(const char *data, size_t size, VcfIndex &idx, Progress *progress)
+{
+    idx = VcfIndex();
 
-        ofs << "\t.\t.\t.";
+    size_t i = 0;
+    std::uint64_t ln = 0;
+    bool header = false;
 
-        if ( gt.ind.empty() ) {
-            ofs << "\n";
-            continue;
+    while (i < size && ! header) {
+        auto p = data + i;
+        auto end = static_cast<const char*>(std::memchr(p, '\n', size - i));
+        size_t n = end ? end - p : size - i;
+        ++ln;
+
+        if (p[0] != '#') {
+            log_stream() << "ERROR: VCF header line is required\n";
+            return 1;
         }
 
-        line.clear();
-        line.append("\tGT");
-
-        if ( haploid ) {
-            for (size_t i = 0; i < n; ++i) {
-                auto a = gt.dat[j][i];
-                line.append("\t").append(codes[a]);
-                if ( force_diploid )
-                    line.append("/").append(codes[a]);
+        if (n < 2 || p[1] != '#') {
+            std::string s(p, n);
+            if ( ! s.empty() && s.back() == '\r' )
+                s.pop_back();
+            if (parse_vcf_header(s, idx.ind) != 0) {
+                log_stream() << "ERROR: invalid VCF header at line " << ln << "\n";
+                return 1;
             }
+            header = true;
         }
-        else {
-            for (size_t i = 0; i < n; ++i) {
-                auto a = gt.dat[j][i*2], b = gt.dat[j][i*2+1];
-                line.append("\t").append(codes[a]).append("/").append(codes[b]);
-            }
+
+        i += end ? n + 1 : n;
+
+        if (progress && ! progress->add(n + 1, 1))
+            return 1;
+    }
+
+    if ( ! header ) {
+        log_stream() << "ERROR: VCF header line is required\n";
+        return 1;
+    }
+
+    idx.header = i;
+
+    // input is usually grouped by chromosome, look up the previous one first, then the map
+    size_t c = 0;
+    std::unordered_map<std::string, size_t> chr_index;
+
+    while (i < size) {
+        auto p = data + i;
+        auto end = static_cast<const char*>(std::memchr(p, '\n', size - i));
+        size_t n = end ? end - p : size - i;
+        ++ln;
+
+        auto len = n;
+        if (len > 0 && p[len-1] == '\r')
+            --len;
+
+        auto t1 = static_cast<const char*>(std::memchr(p, '\t', len));
+        auto t2 = t1 ? static_cast<const char*>(std::memchr(t1 + 1, '\t', len - (t1 + 1 - p))) : nullptr;
+
+        pos_t pos = 0;
+        if ( ! t2 || t1 == p || ! parse_integer(t1 + 1, t2 - t1 - 1, pos) ) {
+            log_stream() << "ERROR: invalid VCF entry at line " << ln << "\n";
+            return 1;
+        }
+
+        Token chr(p, t1 - p);
+        if (idx.chr.empty() || Token(idx.chr[c].data(), idx.chr[c].size()) != chr) {
+            auto ins = chr_index.emplace(chr.to_string(), idx.chr.size());
+            c = ins.first->second;
+            if ( ins.second )
+                idx.chr.push_back(ins.first->first);
         }
 
-        ofs << line << "\n";
+        idx.line.push_back({ i, len, pos, c });
+
+        i += end ? n + 1 : n;
+
+        if (progress && ! progress->add(n + 1, 1))
+            return 1;
+    }
+
+    return 0;
+}
+
+void sort_vcf_index(VcfIndex &idx, Progress *progress)
+{
+    auto nc = idx.chr.size();
+
+    auto ord = order(idx.chr);
+    std::vector<size_t> rank(nc);
+    for (size_t k = 0; k < nc; ++k)
+        rank[ord[k]] = k;
+
+    auto less = [&rank](const VcfLine &a, const VcfLine &b) {
+        return rank[a.chr] < rank[b.chr] || (a.chr == b.chr && a.pos < b.pos);
+    };
+
+    if ( ! std::is_sorted(idx.line.begin(), idx.line.end(), less) )
+        std::stable_sort(idx.line.begin(), idx.line.end(), less);
+
+    if ( progress )
+        progress->add(0, idx.line.size());
+}
+
+int write_vcf_index(const char *data, const VcfIndex &idx, const std::string &filename, Progress *progress)
+{
+    LineWriter ofs(filename);
+    if ( ! ofs ) {
+        log_stream() << "ERROR: can't open file for writing: " << filename << "\n";
+        return 1;
+    }
+
+    for (size_t i = 0; i < idx.header; ) {
+        auto p = data + i;
+        auto end = static_cast<const char*>(std::memchr(p, '\n', idx.header - i));
+        size_t n = end ? end - p : idx.header - i;
+        i += end ? n + 1 : n;
+        if (n > 0 && p[n-1] == '\r')
+            --n;
+        ofs.write(p, n).put('\n');
+    }
+
+    for (auto &e : idx.line) {
+        if (progress && ! progress->add(e.length + 1, 1))
+            return 1;
+        ofs.write(data + e.offset, e.length).put('\n');
+    }
+
+    ofs.close();
+    if ( ! ofs ) {
+        log_stream() << "ERROR: failed to write file: " << filename << "\n";
+        return 1;
     }
 
     return 0;
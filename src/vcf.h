@@ -4,6 +4,10 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
 
 
 //
@@ -34,6 +38,115 @@
 
 using allele_t = unsigned char;
 
+using pos_t = std::int64_t;
+
+
+class Progress;
+class GenotypeSummary;
+
+
+// Per-locus properties, recorded by the readers while parsing so that writers check
+// compatibility and choose a coding in O(loci) instead of scanning all genotypes.
+// Missing alleles count in LOCUS_HET, a genotype such as ./1 is not homozygous.
+
+enum LocusFlag
+{
+    LOCUS_ACGT = 1,         // all alleles are single bases A, C, G or T
+    LOCUS_BIALLELIC = 2,    // at most two alleles
+    LOCUS_INDEL = 4,        // an allele is '-' or alleles differ in length
+    LOCUS_HET = 8,          // a genotype of different alleles
+    LOCUS_SEQUENCE = 16,    // all alleles are '-' or strings of A, C, G and T
+    LOCUS_SPARSE = 32       // dat is in the sparse form, see make_sparse
+};
+
+
+// Alleles of a locus, a view of the strings of an AlleleTable or of a vector; valid
+// while these are unchanged
+class AlleleList
+{
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string*;
+        using reference = const std::string&;
+
+        const_iterator(const std::string *str, const std::uint32_t *id, std::size_t k) : str_(str), id_(id), k_(k) {}
+
+        reference operator*() const { return id_ ? str_[id_[k_]] : str_[k_]; }
+        pointer operator->() const { return &**this; }
+        const_iterator& operator++() { ++k_; return *this; }
+        const_iterator operator++(int) { auto t = *this; ++k_; return t; }
+        bool operator==(const const_iterator &other) const { return k_ == other.k_; }
+        bool operator!=(const const_iterator &other) const { return k_ != other.k_; }
+
+    private:
+        const std::string *str_;
+        const std::uint32_t *id_;
+        std::size_t k_;
+    };
+
+    AlleleList(const std::vector<std::string> &as) : str_(as.data()), n_(as.size()) {}
+
+    AlleleList(const std::string *str, const std::uint32_t *id, std::size_t n) : str_(str), id_(id), n_(n) {}
+
+    std::size_t size() const { return n_; }
+
+    bool empty() const { return n_ == 0; }
+
+    const std::string& operator[](std::size_t k) const { return id_ ? str_[id_[k]] : str_[k]; }
+
+    const_iterator begin() const { return const_iterator(str_, id_, 0); }
+
+    const_iterator end() const { return const_iterator(str_, id_, n_); }
+
+private:
+    const std::string *str_;
+    const std::uint32_t *id_ = nullptr;
+    std::size_t n_;
+};
+
+// Alleles of all loci of a genotype: each distinct string is stored once, and the
+// alleles of the loci are ids of those strings in one array. SSR and haplotype loci
+// share most allele strings, which take 4 bytes per allele then instead of a string.
+class AlleleTable
+{
+public:
+    std::size_t size() const { return off_.size() - 1; }
+
+    bool empty() const { return off_.size() == 1; }
+
+    // alleles of locus j
+    AlleleList operator[](std::size_t j) const
+    {
+        return AlleleList(str_.data(), id_.data() + off_[j], off_[j+1] - off_[j]);
+    }
+
+    AlleleList back() const { return (*this)[size() - 1]; }
+
+    void push_back(const AlleleList &as);
+
+    // append the loci of another table
+    void append(const AlleleTable &other);
+
+    // loci idx in that order
+    AlleleTable subset(const std::vector<std::size_t> &idx) const;
+
+    void clear() { *this = AlleleTable(); }
+
+private:
+    std::uint32_t intern(const std::string &s);
+
+private:
+    std::vector<std::string> str_;
+    std::unordered_multimap<std::size_t, std::uint32_t> lookup_;
+    std::vector<std::uint32_t> id_;
+    std::vector<std::size_t> off_ = { 0 };
+};
+
 
 struct VcfEntry
 {
@@ -41,8 +154,9 @@ struct VcfEntry
     std::string id;
     std::vector<std::string> as;
     std::vector<allele_t> gt;
-    int pos = 0;
+    pos_t pos = 0;
     int ploidy = 0;
+    std::uint8_t flag = 0;
 };
 
 
@@ -51,20 +165,163 @@ struct Genotype
     std::vector<std::string> ind;
     std::vector<std::string> loc;
     std::vector<std::string> chr;
-    std::vector<int> pos;
+    std::vector<pos_t> pos;
     std::vector< std::vector<allele_t> > dat;
-    std::vector< std::vector<std::string> > allele;
+    AlleleTable allele;
     int ploidy = 0;
+
+    // LocusFlag bits of each locus, empty if not recorded, see locus_flags
+    std::vector<std::uint8_t> flag;
+
+    // VCF passthrough: ## header lines and data lines as read, written back to VCF
+    // unchanged; dat is empty then and other formats can't be written
+    std::vector<std::string> meta;
+    std::vector<std::string> raw;
 };
 
 
+// Allele codes take one byte per allele; loci of more than 255 alleles take two bytes
+// per allele in native byte order, dat[j] is then twice as long. The width follows from
+// the number of alleles, so biallelic data pays nothing for it.
+
+const int max_alleles = 65534;
+
+inline std::size_t allele_width(std::size_t na)
+{
+    return na > 255 ? 2 : 1;
+}
+
+inline unsigned get_allele(const std::vector<allele_t> &v, std::size_t k, std::size_t width)
+{
+    if (width == 1)
+        return v[k];
+    std::uint16_t a;
+    std::memcpy(&a, &v[k*2], 2);
+    return a;
+}
+
+inline void push_allele(std::vector<allele_t> &v, unsigned a, std::size_t width)
+{
+    if (width == 1)
+        v.push_back(static_cast<allele_t>(a));
+    else {
+        auto b = static_cast<std::uint16_t>(a);
+        auto p = reinterpret_cast<const allele_t*>(&b);
+        v.insert(v.end(), p, p + 2);
+    }
+}
+
+
+// Sparse loci: dat[j] holds the number of allele copies (uint32) and the most common
+// allele, then the copy index (uint32) and allele of each copy that differs from it, in
+// ascending copy order and native byte order. Readers store a locus sparse when that is
+// smaller, which for rare variants is a small fraction of the dense size, and mark it
+// LOCUS_SPARSE; loci without recorded flags are always dense.
+
+const std::size_t sparse_header = 4;
+
+// convert the allele codes of a locus of na alleles to the sparse form if it is smaller;
+// loci of under 64 copies are left dense, as are those of many alleles where a sample of
+// copies shows a common variant
+bool make_sparse(std::vector<allele_t> &v, std::size_t na);
+
+// allele codes of a sparse locus
+void expand_sparse(const std::vector<allele_t> &v, std::size_t na, std::vector<allele_t> &dat);
+
+// allele of copy k of a sparse locus, pos is the offset of the next entry to check, starting
+// at sparse_header + width; copies must be looked up in ascending order
+inline unsigned sparse_allele(const std::vector<allele_t> &v, std::size_t k, std::size_t width, std::size_t &pos)
+{
+    for (; pos < v.size(); pos += 4 + width) {
+        std::uint32_t i;
+        std::memcpy(&i, &v[pos], 4);
+        if (i == k)
+            return get_allele(v, (pos + 4) / width, width);
+        if (i > k)
+            break;
+    }
+
+    return get_allele(v, sparse_header / width, width);
+}
+
+// allele codes of locus j, gt.dat[j] or else expanded into buf
+const std::vector<allele_t>& locus_data(const Genotype &gt, std::size_t j, std::vector<allele_t> &buf);
+
+
+// Writers take an optional list of the loci to write, in that order, so that a subset of
+// a genotype is written without copying it; all loci are written if it is null.
+
+inline std::size_t locus_index(const std::vector<std::size_t> *loci, std::size_t k)
+{
+    return loci ? (*loci)[k] : k;
+}
+
+inline std::size_t locus_count(const Genotype &gt, const std::vector<std::size_t> *loci)
+{
+    return loci ? loci->size() : gt.loc.size();
+}
+
+
+// flags of the alleles of a locus, without LOCUS_HET
+std::uint8_t allele_flags(const AlleleList &as);
+
+// flags of locus j as recorded by the reader, or else computed from its genotypes
+std::uint8_t locus_flags(const Genotype &gt, std::size_t j);
+
+
 int parse_vcf_header(const std::string &s, std::vector<std::string> &v);
 
 int parse_vcf_entry(const std::string &s, VcfEntry &e);
 
-int read_vcf(const std::string &filename, Genotype &gt);
+// parse CHROM to ALT only, genotypes are left undecoded and LOCUS_HET is not set
+int parse_vcf_site(const std::string &s, VcfEntry &e);
+
+// passthrough keeps header and data lines in gt.meta and gt.raw instead of decoding genotypes;
+// loci are counted into the summary as they are parsed if one is given
+int read_vcf(const std::string &filename, Genotype &gt, Progress *progress = nullptr, bool passthrough = false,
+             GenotypeSummary *summary = nullptr);
+
+// read VCF files with identical sample columns concurrently, loci are concatenated in input order;
+// each file is opened twice, so none can be stdin
+int read_vcf(const std::vector<std::string> &filenames, Genotype &gt, Progress *progress = nullptr,
+             bool passthrough = false, GenotypeSummary *summary = nullptr);
+
+// meta lines replace the default ##fileformat line
+std::string format_vcf_header(const std::vector<std::string> &ind, const std::vector<std::string> &meta = {});
+
+// append a VCF data line without newline, the ploidy of a locus of n samples is
+// dat.size() / n / allele_width(as.size())
+void format_vcf_entry(const std::string &chr, pos_t pos, const std::string &id, const AlleleList &as,
+                      const std::vector<allele_t> &dat, std::size_t n, bool force_diploid, std::string &line);
+
+int write_vcf(const Genotype &gt, const std::string &filename, bool force_diploid = true, Progress *progress = nullptr,
+              const std::vector<std::size_t> *loci = nullptr);
+
+
+// Data lines of a VCF file in memory, sorted by chromosome and position without
+// tokenizing the samples; header and data lines are copied as read
+struct VcfLine
+{
+    std::uint64_t offset;
+    std::uint64_t length;
+    pos_t pos;
+    std::size_t chr;
+};
+
+struct VcfIndex
+{
+    std::size_t header = 0;
+    std::vector<std::string> ind;
+    std::vector<std::string> chr;
+    std::vector<VcfLine> line;
+};
+
+int index_vcf(const char *data, std::size_t size, VcfIndex &idx, Progress *progress = nullptr);
+
+// ascending chromosome position order as sort_chrpos, ties keep input order
+void sort_vcf_index(VcfIndex &idx, Progress *progress = nullptr);
 
-int write_vcf(const Genotype &gt, const std::string &filename, bool force_diploid = true);
+int write_vcf_index(const char *data, const VcfIndex &idx, const std::string &filename, Progress *progress = nullptr);
 
 
 #endif // VCF_H
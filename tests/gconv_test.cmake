@@ -0,0 +1,38 @@
+# helpers of the test scripts, which are run as
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P <script>.cmake
+#
+# file names are relative to WORK_DIR
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+# run gconv with the given arguments in WORK_DIR, a failure is fatal
+function(gconv_run)
+    execute_process(COMMAND ${GCONV} ${ARGN} WORKING_DIRECTORY ${WORK_DIR}
+                    RESULT_VARIABLE result ERROR_VARIABLE error)
+    if (NOT result EQUAL 0)
+        string(REPLACE ";" " " args "${ARGN}")
+        message(FATAL_ERROR "gconv ${args} failed: ${result}\n${error}")
+    endif()
+endfunction()
+
+# run gconv with the given arguments in WORK_DIR, it must fail with an error containing message
+function(gconv_fail message)
+    execute_process(COMMAND ${GCONV} ${ARGN} WORKING_DIRECTORY ${WORK_DIR}
+                    RESULT_VARIABLE result ERROR_VARIABLE error)
+    string(FIND "${error}" "${message}" at)
+    if (result EQUAL 0 OR at EQUAL -1)
+        string(REPLACE ";" " " args "${ARGN}")
+        message(FATAL_ERROR "gconv ${args} must fail with \"${message}\": ${result}\n${error}")
+    endif()
+endfunction()
+
+# output must be identical to expected
+function(compare_output expected output)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/${expected} ${WORK_DIR}/${output}
+                    RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        file(READ ${WORK_DIR}/${output} text)
+        message(FATAL_ERROR "${output} differs from ${expected}:\n${text}")
+    endif()
+endfunction()
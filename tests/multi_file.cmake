@@ -0,0 +1,49 @@
+# several VCF inputs must be converted and split as their concatenation is, and stdin
+# can't be one of them
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P multi_file.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/gconv_test.cmake)
+
+string(CONCAT header
+    "##fileformat=VCFv4.2\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\tS3\n")
+
+string(CONCAT part1
+    "1\t100\tm1\tT\tC\t.\tPASS\t.\tGT\t0/0\t0/1\t1/1\n"
+    "1\t200\tm2\tC\tT,G\t.\tPASS\t.\tGT\t0/2\t1/1\t./.\n")
+string(CONCAT part2
+    "2\t100\tm3\tG\tA\t.\tPASS\t.\tGT\t1/0\t./.\t0/0\n"
+    "1\t300\tm4\tA\tG\t.\tPASS\t.\tGT\t0/1\t1/1\t0|1\n")
+string(CONCAT part3
+    "3\t50\tm5\tC\tA\t.\tPASS\t.\tGT\t0/0\t0/0\t0/1\n")
+
+file(WRITE ${WORK_DIR}/multi1.vcf "${header}${part1}")
+file(WRITE ${WORK_DIR}/multi2.vcf "${header}${part2}")
+file(WRITE ${WORK_DIR}/multi3.vcf "${header}${part3}")
+file(WRITE ${WORK_DIR}/multi.vcf "${header}${part1}${part2}${part3}")
+
+foreach (ext vcf geno)
+    gconv_run(--vcf multi.vcf --out multi.expected.${ext})
+    gconv_run(--vcf multi1.vcf,multi2.vcf,multi3.vcf --out multi.concat.${ext})
+    compare_output(multi.expected.${ext} multi.concat.${ext})
+
+    gconv_run(--vcf multi.vcf --out multi_sorted.expected.${ext} --sort)
+    gconv_run(--vcf multi1.vcf,multi2.vcf,multi3.vcf --out multi_sorted.concat.${ext} --sort)
+    compare_output(multi_sorted.expected.${ext} multi_sorted.concat.${ext})
+
+    gconv_run(--vcf multi.vcf --out multi_split.expected.${ext} --split-by-chr)
+    gconv_run(--vcf multi1.vcf,multi2.vcf,multi3.vcf --out multi_split.concat.${ext} --split-by-chr)
+    foreach (chr 1 2 3)
+        compare_output(multi_split.expected.${chr}.${ext} multi_split.concat.${chr}.${ext})
+    endforeach()
+endforeach()
+
+gconv_run(--vcf multi1.vcf,multi2.vcf --out multi.passthrough.vcf --passthrough)
+file(READ ${WORK_DIR}/multi.passthrough.vcf text)
+string(FIND "${text}" "${part1}${part2}" at)
+if (at EQUAL -1)
+    message(FATAL_ERROR "data lines are not copied in input order:\n${text}")
+endif()
+
+gconv_fail("stdin (-) can't be one of several input files" --vcf multi1.vcf,- --out multi.stdin.vcf)
@@ -0,0 +1,63 @@
+# PED output written with --memory-limit, which spills tiles of loci to a temporary file and
+# merges them in several passes, must equal PED output written from memory
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P ped_memory_limit.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/gconv_test.cmake)
+
+# 128K holds 327 loci of 100 samples, so the 2000 loci make 7 tiles, merged 2 at a time
+set(n 100)
+set(m 2000)
+
+set(header "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT")
+foreach (i RANGE 1 ${n})
+    string(APPEND header "\tS${i}")
+endforeach()
+
+# 7 genotype rows, each of the samples in a different order of genotypes
+set(gt "0/0" "0/1" "1/1" "./." "1/0" "0/0" "0/1")
+foreach (r RANGE 6)
+    set(row${r} "")
+    foreach (i RANGE 1 ${n})
+        math(EXPR g "(${i} * (${r} + 1) + ${i} / 7) % 7")
+        list(GET gt ${g} x)
+        string(APPEND row${r} "\t${x}")
+    endforeach()
+endforeach()
+
+set(vcf "${header}\n")
+set(ref A C G T)
+foreach (j RANGE 1 ${m})
+    math(EXPR r "${j} % 7")
+    math(EXPR a "${j} % 4")
+    math(EXPR b "(${j} + 1 + ${j} / 4 % 3) % 4")
+    math(EXPR chr "${j} / 700 + 1")
+    list(GET ref ${a} x)
+    list(GET ref ${b} y)
+    string(APPEND vcf "${chr}\t${j}\tm${j}\t${x}\t${y}\t.\tPASS\t.\tGT${row${r}}\n")
+endforeach()
+
+file(WRITE ${WORK_DIR}/tiles.vcf "${vcf}")
+
+gconv_run(--vcf tiles.vcf --out tiles.expected.ped)
+gconv_run(--vcf tiles.vcf --out tiles.ped --memory-limit 128K)
+compare_output(tiles.expected.ped tiles.ped)
+compare_output(tiles.expected.map tiles.map)
+
+# each chromosome file of 3 tiles, and the sorted loci
+gconv_run(--vcf tiles.vcf --out tiles_split.expected.ped --split-by-chr)
+gconv_run(--vcf tiles.vcf --out tiles_split.ped --split-by-chr --memory-limit 128K)
+foreach (chr 1 2 3)
+    compare_output(tiles_split.expected.${chr}.ped tiles_split.${chr}.ped)
+    compare_output(tiles_split.expected.${chr}.map tiles_split.${chr}.map)
+endforeach()
+
+gconv_run(--vcf tiles.vcf --out tiles_sorted.expected.ped --sort)
+gconv_run(--vcf tiles.vcf --out tiles_sorted.ped --sort --memory-limit 128K)
+compare_output(tiles_sorted.expected.ped tiles_sorted.ped)
+compare_output(tiles_sorted.expected.map tiles_sorted.map)
+
+file(GLOB leftover ${WORK_DIR}/tiles*.ped.*)
+if (leftover)
+    message(FATAL_ERROR "temporary file left: ${leftover}")
+endif()
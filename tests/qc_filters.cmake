@@ -0,0 +1,41 @@
+# --maf, --max-missing and --drop-monomorphic must write the loci a plain conversion of the
+# passing loci writes, whether the input is loaded (VCF) or streamed (PED with --memory-limit)
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P qc_filters.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/gconv_test.cmake)
+
+string(CONCAT header
+    "##fileformat=VCFv4.2\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\tS3\tS4\n")
+
+# monomorphic, minor allele frequency 0.125, missing rate 0.5, kept, kept
+set(m1 "1\t100\tm1\tA\tG\t.\tPASS\t.\tGT\t1/1\t1/1\t1/1\t1/1\n")
+set(m2 "1\t200\tm2\tC\tT\t.\tPASS\t.\tGT\t0/0\t0/0\t0/0\t0/1\n")
+set(m3 "1\t300\tm3\tG\tA\t.\tPASS\t.\tGT\t./.\t./.\t0/1\t1/1\n")
+set(m4 "2\t100\tm4\tT\tC\t.\tPASS\t.\tGT\t0/1\t0/0\t1/1\t0/1\n")
+set(m5 "2\t200\tm5\tA\tC\t.\tPASS\t.\tGT\t0/0\t./.\t0/1\t0/1\n")
+
+file(WRITE ${WORK_DIR}/qc.vcf "${header}${m1}${m2}${m3}${m4}${m5}")
+file(WRITE ${WORK_DIR}/qc_maf.vcf "${header}${m3}${m4}${m5}")
+file(WRITE ${WORK_DIR}/qc_max_missing.vcf "${header}${m1}${m2}${m4}${m5}")
+file(WRITE ${WORK_DIR}/qc_drop_monomorphic.vcf "${header}${m2}${m3}${m4}${m5}")
+
+foreach (filter maf max_missing drop_monomorphic)
+    if (filter STREQUAL "maf")
+        set(args --maf 0.2)
+    elseif (filter STREQUAL "max_missing")
+        set(args --max-missing 0.3)
+    else()
+        set(args --drop-monomorphic)
+    endif()
+
+    gconv_run(--vcf qc_${filter}.vcf --out qc_${filter}.expected.vcf)
+    gconv_run(--vcf qc.vcf --out qc_${filter}.filtered.vcf ${args})
+    compare_output(qc_${filter}.expected.vcf qc_${filter}.filtered.vcf)
+
+    gconv_run(--vcf qc_${filter}.vcf --out qc_${filter}.expected.ped)
+    gconv_run(--vcf qc.vcf --out qc_${filter}.filtered.ped --memory-limit 128K ${args})
+    compare_output(qc_${filter}.expected.ped qc_${filter}.filtered.ped)
+    compare_output(qc_${filter}.expected.map qc_${filter}.filtered.map)
+endforeach()
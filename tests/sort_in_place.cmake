@@ -0,0 +1,46 @@
+# gconv --vcf x.vcf --passthrough --sort --out x.vcf must sort the file in place
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P sort_in_place.cmake
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(in ${WORK_DIR}/in_place.vcf)
+set(expected ${WORK_DIR}/in_place.expected.vcf)
+
+string(CONCAT vcf
+    "##fileformat=VCFv4.2\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\n"
+    "2\t300\tm4\tA\tG\t.\tPASS\t.\tGT\t0/1\t1/1\n"
+    "1\t200\tm2\tC\tT\t.\tPASS\t.\tGT\t0/0\t0/1\n"
+    "2\t100\tm3\tG\tA\t.\tPASS\t.\tGT\t1|0\t./.\n"
+    "1\t100\tm1\tT\tC\t.\tPASS\t.\tGT\t0\t1\n")
+
+string(CONCAT sorted
+    "##fileformat=VCFv4.2\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\n"
+    "1\t100\tm1\tT\tC\t.\tPASS\t.\tGT\t0\t1\n"
+    "1\t200\tm2\tC\tT\t.\tPASS\t.\tGT\t0/0\t0/1\n"
+    "2\t100\tm3\tG\tA\t.\tPASS\t.\tGT\t1|0\t./.\n"
+    "2\t300\tm4\tA\tG\t.\tPASS\t.\tGT\t0/1\t1/1\n")
+
+file(WRITE ${in} "${vcf}")
+file(WRITE ${expected} "${sorted}")
+
+execute_process(COMMAND ${GCONV} --vcf ${in} --passthrough --sort --out ${in}
+                RESULT_VARIABLE result)
+
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "gconv failed: ${result}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${in} ${expected}
+                RESULT_VARIABLE result)
+
+if (NOT result EQUAL 0)
+    file(READ ${in} output)
+    message(FATAL_ERROR "input is not sorted in place:\n${output}")
+endif()
+
+file(GLOB leftover ${in}.*)
+if (leftover)
+    message(FATAL_ERROR "temporary file left: ${leftover}")
+endif()
@@ -0,0 +1,47 @@
+# rare variants, which are held in the sparse form once loaded, must convert back to the
+# genotypes of the input: VCF -> geno -> VCF and a sorted VCF must equal the plain VCF
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P sparse_round_trip.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/gconv_test.cmake)
+
+set(n 200)
+
+set(header "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT")
+foreach (i RANGE 1 ${n})
+    string(APPEND header "\tS${i}")
+endforeach()
+
+# a locus of genotype gt in all samples but those listed as sample=genotype; alleles are
+# in sorted order, as the general format lists them
+function(rare_locus var site gt)
+    set(line "${site}\t.\tPASS\t.\tGT")
+    foreach (i RANGE 1 ${n})
+        set(g ${gt})
+        foreach (e ${ARGN})
+            if (e MATCHES "^${i}=(.*)$")
+                set(g ${CMAKE_MATCH_1})
+            endif()
+        endforeach()
+        string(APPEND line "\t${g}")
+    endforeach()
+    set(${var} "${line}\n" PARENT_SCOPE)
+endfunction()
+
+rare_locus(m1 "1\t100\tm1\tA\tG" 0/0 137=0/1)
+rare_locus(m2 "1\t200\tm2\tC\tT" 0/0 50=./. 199=1/1 200=0|1)
+rare_locus(m3 "1\t300\tm3\tA\tC,G,T" 0/0 10=0/1 20=0/2 30=3/3 31=./.)
+rare_locus(m4 "2\t100\tm4\tC\tT" 1/1 1=0/1 2=0/0)
+rare_locus(m5 "2\t200\tm5\tA\tC" 0/1)
+rare_locus(m6 "2\t300\tm6\tC\tG" ./. 7=0/1)
+
+file(WRITE ${WORK_DIR}/sparse.vcf "${header}\n${m1}${m2}${m3}${m4}${m5}${m6}")
+
+gconv_run(--vcf sparse.vcf --out sparse.expected.vcf)
+
+gconv_run(--vcf sparse.vcf --out sparse.geno)
+gconv_run(--geno sparse.geno --out sparse.geno.vcf)
+compare_output(sparse.expected.vcf sparse.geno.vcf)
+
+gconv_run(--vcf sparse.vcf --out sparse.sorted.vcf --sort)
+compare_output(sparse.expected.vcf sparse.sorted.vcf)
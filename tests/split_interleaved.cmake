@@ -0,0 +1,28 @@
+# gconv --vcf x.vcf --split-by-chr must write the same chromosome files whether or not the
+# loci of x.vcf are grouped by chromosome, and the same as with --sort
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P split_interleaved.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/gconv_test.cmake)
+
+string(CONCAT header
+    "##fileformat=VCFv4.2\n"
+    "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\n")
+
+set(m1 "1\t100\tm1\tT\tC\t.\tPASS\t.\tGT\t0/0\t0/1\n")
+set(m2 "1\t200\tm2\tC\tT,G\t.\tPASS\t.\tGT\t0/2\t1/1\n")
+set(m3 "2\t100\tm3\tG\tA\t.\tPASS\t.\tGT\t1/0\t./.\n")
+set(m4 "2\t300\tm4\tA\tG\t.\tPASS\t.\tGT\t0/1\t1/1\n")
+
+file(WRITE ${WORK_DIR}/split_interleaved.vcf "${header}${m1}${m3}${m2}${m4}")
+file(WRITE ${WORK_DIR}/split_grouped.vcf "${header}${m1}${m2}${m3}${m4}")
+
+foreach (ext vcf geno)
+    gconv_run(--vcf split_interleaved.vcf --out interleaved.${ext} --split-by-chr)
+    gconv_run(--vcf split_grouped.vcf --out grouped.${ext} --split-by-chr)
+    gconv_run(--vcf split_interleaved.vcf --out sorted.${ext} --split-by-chr --sort)
+    foreach (chr 1 2)
+        compare_output(sorted.${chr}.${ext} interleaved.${chr}.${ext})
+        compare_output(sorted.${chr}.${ext} grouped.${chr}.${ext})
+    endforeach()
+endforeach()
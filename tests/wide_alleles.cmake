@@ -0,0 +1,49 @@
+# a locus of more than 255 alleles is held in 16-bit allele codes: VCF -> geno -> VCF must
+# equal the plain VCF
+#
+#   cmake -DGCONV=<gconv> -DWORK_DIR=<dir> -P wide_alleles.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/gconv_test.cmake)
+
+# 300 alternative alleles AA, AAA, ..., sample i is (i-1)/i so that each allele is called;
+# the general format keeps the called alleles only, in sorted order, as they are here
+set(n 300)
+
+set(header "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT")
+set(alt "")
+set(allele "A")
+set(wide "")
+set(narrow "")
+foreach (i RANGE 1 ${n})
+    string(APPEND header "\tS${i}")
+    string(APPEND allele "A")
+    list(APPEND alt ${allele})
+    math(EXPR j "${i} - 1")
+    string(APPEND wide "\t${j}/${i}")
+    math(EXPR k "${i} % 3")
+    if (k EQUAL 0)
+        string(APPEND narrow "\t./.")
+    else()
+        string(APPEND narrow "\t0/${k}")
+    endif()
+endforeach()
+string(REPLACE ";" "," alt "${alt}")
+
+string(CONCAT vcf
+    "${header}\n"
+    "1\t100\tm1\tA\tC,G\t.\tPASS\t.\tGT${narrow}\n"
+    "1\t200\tm2\tA\t${alt}\t.\tPASS\t.\tGT${wide}\n"
+    "1\t300\tm3\tC\tG,T\t.\tPASS\t.\tGT${narrow}\n")
+
+file(WRITE ${WORK_DIR}/wide.vcf "${vcf}")
+
+gconv_run(--vcf wide.vcf --out wide.expected.vcf)
+gconv_run(--vcf wide.vcf --out wide.geno)
+gconv_run(--geno wide.geno --out wide.geno.vcf)
+compare_output(wide.expected.vcf wide.geno.vcf)
+
+file(STRINGS ${WORK_DIR}/wide.geno.vcf lines REGEX "\tm2\t")
+string(FIND "${lines}" "\t299/300" at)
+if (at EQUAL -1)
+    message(FATAL_ERROR "allele 300 is lost:\n${lines}")
+endif()